@@ -142,6 +142,9 @@ main (int argc, char *argv[])
   double nodeSpeed = 10; // 1.5, 5, 10, 15, 20, 25 [m/s]
   uint32_t areaSide = 500; // [m] square area
   uint8_t appStartDistance = 0; // [s] time that shuld be enough to find the route and stop sendnig new RREQ packets
+  bool hopHistory = false; // seed the RREQ TTL from the last known hop count
+  uint32_t nRadios = 1; // 802.11b radios per node, each on its own orthogonal channel (1 - 3)
+  bool channelStriping = false; // rebroadcast RREQs on the other channels first
 
   CommandLine cmd;
   cmd.AddValue ("phyMode", "Wifi Phy mode", phyMode);
@@ -156,7 +159,14 @@ main (int argc, char *argv[])
   cmd.AddValue ("areaSide", "Side of square simulation area in meters", areaSide);
   cmd.AddValue ("nodeSpeed", "Constant speed of nodes in Gaus-Marcov model", nodeSpeed);
   cmd.AddValue ("appStartDistance", "Time between application start (that shuld be enough to find the route and stop sendnig new RREQ packets)", appStartDistance);
+  cmd.AddValue ("hopHistory", "Start the expanding ring search of a rediscovery at the last known hop count", hopHistory);
+  cmd.AddValue ("nRadios", "Number of radios per node, each on its own orthogonal channel (1 - 3)", nRadios);
+  cmd.AddValue ("channelStriping", "Delay the RREQ rebroadcast on the channel the RREQ arrived on", channelStriping);
   cmd.Parse (argc, argv);
+  if (nRadios < 1 || nRadios > 3)
+  {
+    NS_FATAL_ERROR ("nRadios must be between 1 and 3");
+  }
 
   // File names. Changes: nActiveNodes, dataRate
   csvFileNamePrefix += "-" + std::to_string (areaSide) + "mx" + std::to_string (areaSide) + "m"
@@ -164,6 +174,18 @@ main (int argc, char *argv[])
                     + "-" + dataRateStr  
                     + "-speed" + std::to_string (nodeSpeed) 
                     + "-" + std::to_string (packetSize) + "B";
+  if (hopHistory)
+  {
+    csvFileNamePrefix += "-hh";
+  }
+  if (nRadios > 1)
+  {
+    csvFileNamePrefix += "-radios" + std::to_string (nRadios);
+  }
+  if (channelStriping)
+  {
+    csvFileNamePrefix += "-cs";
+  }
   std::string flowFileName = csvFileNamePrefix + "-flow.csv";
   overheadFileName = csvFileNamePrefix + "-overhead.csv";
   
@@ -222,7 +244,6 @@ main (int argc, char *argv[])
                                   "Exponent", DoubleValue (2.8),
                                   "ReferenceDistance", DoubleValue (1.0),
                                   "ReferenceLoss", DoubleValue (40.046));
-  wifiPhy.SetChannel (wifiChannel.Create ());
 
   // Add a mac and disable rate control
   WifiMacHelper wifiMac;
@@ -231,19 +252,36 @@ main (int argc, char *argv[])
                                 "ControlMode",StringValue (phyMode));
   // Set it to adhoc mode
   wifiMac.SetType ("ns3::AdhocWifiMac");
-  NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, c);
+  // Radio k of every node uses 802.11b channel 1, 6 or 11. These channels do not
+  // overlap, so each of them is a separate medium.
+  const uint16_t channelNumbers[] = {1, 6, 11};
+  std::vector<NetDeviceContainer> devices (nRadios);
+  for (uint32_t k = 0; k < nRadios; k++)
+  {
+    wifiPhy.SetChannel (wifiChannel.Create ());
+    wifiPhy.Set ("ChannelNumber", UintegerValue (channelNumbers[k]));
+    devices[k] = wifi.Install (wifiPhy, wifiMac, c);
+  }
 
   InternetStackHelper internet;
   // AODV - set routing protocol !!!
   AodvHelper aodv;
   aodv.Set ("EnableHello", BooleanValue (false));
+  aodv.Set ("EnableHopHistory", BooleanValue (hopHistory));
+  aodv.Set ("EnableChannelStriping", BooleanValue (channelStriping));
   internet.SetRoutingHelper(aodv);
   internet.Install (c);
 
   Ipv4AddressHelper ipv4;
   NS_LOG_INFO ("Assign IP Addresses.");
-  ipv4.SetBase ("192.168.1.0", "255.255.255.0");
-  Ipv4InterfaceContainer i = ipv4.Assign (devices);
+  // Radio k is on subnet 192.168.k+1.0; the sinks are addressed on the first one
+  for (uint32_t k = 0; k < nRadios; k++)
+  {
+    std::ostringstream subnet;
+    subnet << "192.168." << k+1 << ".0";
+    ipv4.SetBase (Ipv4Address (subnet.str ().c_str ()), "255.255.255.0");
+    ipv4.Assign (devices[k]);
+  }
 
   // Applications
   TypeId tid = TypeId::LookupByName (protocol); // Set transport layer protocol TCP or UDP
@@ -31,6 +31,7 @@
 #include "aodv-routing-protocol.h"
 #include "ns3/log.h"
 #include "ns3/boolean.h"
+#include "ns3/double.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/inet-socket-address.h"
 #include "ns3/trace-source-accessor.h"
@@ -136,6 +137,1110 @@ private:
 
 NS_OBJECT_ENSURE_REGISTERED (DeferredRouteOutputTag);
 
+/**
+ * \ingroup aodv
+ * \brief Extension appended to a RREQ or RREP carrying the summed load of the relays it went through
+ *
+  \verbatim
+  0                   1                   2                   3
+  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |     Type      |    Length     |             Load
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+                                  |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  \endverbatim
+ */
+class LoadExtensionHeader : public Header
+{
+
+public:
+  /// Extension type, out of the range of the AODV message types
+  static const uint8_t LOAD_EXTENSION = 64;
+
+  /**
+   * \brief Constructor
+   * \param load the load
+   */
+  LoadExtensionHeader (uint32_t load = 0) : Header (),
+                                            m_valid (true),
+                                            m_load (load)
+  {
+  }
+
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId ()
+  {
+    static TypeId tid = TypeId ("ns3::aodv::LoadExtensionHeader")
+      .SetParent<Header> ()
+      .SetGroupName ("Aodv")
+      .AddConstructor<LoadExtensionHeader> ()
+    ;
+    return tid;
+  }
+
+  TypeId  GetInstanceTypeId () const
+  {
+    return GetTypeId ();
+  }
+
+  /**
+   * \brief Check that the bytes read were a load extension
+   * \return true if the extension type matched
+   */
+  bool IsValid () const
+  {
+    return m_valid;
+  }
+
+  /**
+   * \brief Get the load
+   * \return the load
+   */
+  uint32_t GetLoad () const
+  {
+    return m_load;
+  }
+
+  uint32_t GetSerializedSize () const
+  {
+    return 6;
+  }
+
+  void  Serialize (Buffer::Iterator i) const
+  {
+    i.WriteU8 (LOAD_EXTENSION);
+    i.WriteU8 (4);
+    i.WriteHtonU32 (m_load);
+  }
+
+  uint32_t  Deserialize (Buffer::Iterator start)
+  {
+    Buffer::Iterator i = start;
+    m_valid = (i.ReadU8 () == LOAD_EXTENSION);
+    m_valid &= (i.ReadU8 () == 4);
+    m_load = i.ReadNtohU32 ();
+    return i.GetDistanceFrom (start);
+  }
+
+  void  Print (std::ostream &os) const
+  {
+    os << "LoadExtension: load = " << m_load;
+  }
+
+private:
+  /// Whether the bytes read were a load extension
+  bool m_valid;
+  /// Summed load of the relays
+  uint32_t m_load;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (LoadExtensionHeader);
+
+//-----------------------------------------------------------------------------
+TimerWheel::TimerWheel (Time resolution)
+  : m_resolution (resolution),
+    m_currentTick (0),
+    m_armedTick (0),
+    m_nextId (1)
+{
+  for (uint32_t level = 0; level < LEVELS; ++level)
+    {
+      m_levelCount[level] = 0;
+    }
+}
+
+TimerWheel::TimerId
+TimerWheel::Schedule (Time delay, Handler handler, Ipv4Address address)
+{
+  int64_t step = m_resolution.GetTimeStep ();
+  if (m_timers.empty ())
+    {
+      // Nothing is filed, so the wheel can jump over the idle ticks
+      Clear ();
+      m_currentTick = std::max<uint64_t> (m_currentTick, Simulator::Now ().GetTimeStep () / step);
+    }
+  uint64_t tick = ((Simulator::Now () + delay).GetTimeStep () + step - 1) / step;
+  tick = std::max (tick, m_currentTick + 1);
+  TimerId id = m_nextId++;
+  Entry entry;
+  entry.tick = tick;
+  entry.handler = handler;
+  entry.address = address;
+  m_timers.insert (std::make_pair (id, entry));
+  Insert (id, tick);
+  Arm ();
+  return id;
+}
+
+void
+TimerWheel::Cancel (TimerId id)
+{
+  m_timers.erase (id);
+  if (m_timers.empty ())
+    {
+      Clear ();
+    }
+}
+
+bool
+TimerWheel::IsRunning (TimerId id) const
+{
+  return m_timers.find (id) != m_timers.end ();
+}
+
+void
+TimerWheel::Clear ()
+{
+  m_event.Cancel ();
+  m_timers.clear ();
+  for (uint32_t level = 0; level < LEVELS; ++level)
+    {
+      if (m_levelCount[level] == 0)
+        {
+          continue;
+        }
+      for (uint32_t slot = 0; slot < SLOTS; ++slot)
+        {
+          m_slots[level][slot].clear ();
+        }
+      m_levelCount[level] = 0;
+    }
+}
+
+void
+TimerWheel::Insert (TimerId id, uint64_t tick)
+{
+  // Timers beyond the top level wait in its last slot and are filed again on cascade
+  uint64_t horizon = m_currentTick + (uint64_t (1) << (SLOT_BITS * LEVELS)) - 1;
+  tick = std::min (tick, horizon);
+  uint32_t level = 0;
+  while (level + 1 < LEVELS && tick - m_currentTick >= (uint64_t (1) << (SLOT_BITS * (level + 1))))
+    {
+      ++level;
+    }
+  m_slots[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back (id);
+  ++m_levelCount[level];
+}
+
+void
+TimerWheel::Cascade (uint32_t level, uint32_t slot)
+{
+  std::vector<TimerId> ids;
+  ids.swap (m_slots[level][slot]);
+  m_levelCount[level] -= ids.size ();
+  for (std::vector<TimerId>::const_iterator i = ids.begin (); i != ids.end (); ++i)
+    {
+      std::map<TimerId, Entry>::const_iterator timer = m_timers.find (*i);
+      if (timer != m_timers.end ())
+        {
+          Insert (*i, timer->second.tick);
+        }
+    }
+}
+
+void
+TimerWheel::Expire ()
+{
+  m_currentTick = m_armedTick;
+  uint64_t tick = m_currentTick;
+  for (uint32_t level = LEVELS - 1; level > 0; --level)
+    {
+      // Upper level slots move down when all lower levels wrap around
+      if ((tick & ((uint64_t (1) << (SLOT_BITS * level)) - 1)) == 0)
+        {
+          Cascade (level, (tick >> (SLOT_BITS * level)) & (SLOTS - 1));
+        }
+    }
+  std::vector<TimerId> ids;
+  ids.swap (m_slots[0][tick & (SLOTS - 1)]);
+  m_levelCount[0] -= ids.size ();
+  for (std::vector<TimerId>::const_iterator i = ids.begin (); i != ids.end (); ++i)
+    {
+      std::map<TimerId, Entry>::iterator timer = m_timers.find (*i);
+      if (timer == m_timers.end ())
+        {
+          continue;
+        }
+      Handler handler = timer->second.handler;
+      Ipv4Address address = timer->second.address;
+      m_timers.erase (timer);
+      handler (address);
+    }
+  Arm ();
+}
+
+void
+TimerWheel::Arm ()
+{
+  uint64_t next = 0;
+  if (m_levelCount[0] > 0)
+    {
+      for (uint64_t tick = m_currentTick + 1; tick <= m_currentTick + SLOTS; ++tick)
+        {
+          if (!m_slots[0][tick & (SLOTS - 1)].empty ())
+            {
+              next = tick;
+              break;
+            }
+        }
+    }
+  if (m_levelCount[1] + m_levelCount[2] > 0)
+    {
+      uint64_t wrap = ((m_currentTick >> SLOT_BITS) + 1) << SLOT_BITS;
+      if (next == 0 || wrap < next)
+        {
+          next = wrap;
+        }
+    }
+  if (next == 0)
+    {
+      m_event.Cancel ();
+      return;
+    }
+  if (m_event.IsRunning () && m_armedTick == next)
+    {
+      return;
+    }
+  m_event.Cancel ();
+  m_armedTick = next;
+  Time at = TimeStep (next * m_resolution.GetTimeStep ());
+  Time delay = at > Simulator::Now () ? at - Simulator::Now () : Seconds (0);
+  m_event = Simulator::Schedule (delay, &TimerWheel::Expire, this);
+}
+
+//-----------------------------------------------------------------------------
+TokenBucket::TokenBucket ()
+  : m_rate (0),
+    m_fullTime (Seconds (0))
+{
+}
+
+void
+TokenBucket::SetRate (uint32_t rate)
+{
+  m_rate = rate;
+  m_interval = rate ? Seconds (1.0 / rate) : Seconds (0);
+  m_fullTime = Simulator::Now ();
+}
+
+bool
+TokenBucket::HasToken () const
+{
+  return m_rate != 0 && GetDelay ().IsZero ();
+}
+
+bool
+TokenBucket::Consume ()
+{
+  if (!HasToken ())
+    {
+      return false;
+    }
+  m_fullTime = std::max (m_fullTime, Simulator::Now ()) + m_interval;
+  return true;
+}
+
+Time
+TokenBucket::GetDelay () const
+{
+  if (m_rate == 0)
+    {
+      return Seconds (1);
+    }
+  // A token is available while the bucket is at most (rate - 1) tokens short of full
+  Time delay = m_fullTime - Simulator::Now () - (m_rate - 1) * m_interval;
+  return delay.IsStrictlyPositive () ? delay : Seconds (0);
+}
+
+//-----------------------------------------------------------------------------
+DuplicateCache::DuplicateCache (Time lifetime)
+  : m_lifetime (lifetime),
+    m_used (0)
+{
+  m_slots.resize (MIN_SLOTS);
+}
+
+void
+DuplicateCache::SetLifetime (Time lifetime)
+{
+  m_lifetime = lifetime;
+  m_slots.assign (MIN_SLOTS, Slot ());
+  m_used = 0;
+}
+
+uint32_t
+DuplicateCache::GetGeneration () const
+{
+  int64_t span = std::max<int64_t> (m_lifetime.GetTimeStep () / GENERATIONS, 1);
+  return static_cast<uint32_t> (Simulator::Now ().GetTimeStep () / span) + 1;
+}
+
+uint32_t
+DuplicateCache::Hash (uint32_t addr, uint32_t id)
+{
+  uint64_t key = (uint64_t (addr) << 32) | id;
+  return static_cast<uint32_t> ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+bool
+DuplicateCache::IsDuplicate (Ptr<const Packet> p, const Ipv4Header & header)
+{
+  return IsDuplicate (header.GetSource (), p->GetUid ());
+}
+
+bool
+DuplicateCache::IsDuplicate (Ipv4Address addr, uint32_t id)
+{
+  uint32_t now = GetGeneration ();
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t i = Hash (addr.Get (), id) & mask;
+  uint32_t reusable = m_slots.size ();
+  // The load is kept under one half, so a never used slot ends every probe sequence
+  for (; m_slots[i].generation != 0; i = (i + 1) & mask)
+    {
+      Slot const & slot = m_slots[i];
+      if (now - slot.generation > GENERATIONS)
+        {
+          if (reusable == m_slots.size ())
+            {
+              reusable = i;
+            }
+          continue;
+        }
+      if (slot.addr == addr.Get () && slot.id == id)
+        {
+          return true;
+        }
+    }
+  if (reusable == m_slots.size ())
+    {
+      reusable = i;
+      ++m_used;
+    }
+  m_slots[reusable].addr = addr.Get ();
+  m_slots[reusable].id = id;
+  m_slots[reusable].generation = now;
+  if (2 * m_used > m_slots.size ())
+    {
+      uint32_t live = 0;
+      for (std::vector<Slot>::const_iterator j = m_slots.begin (); j != m_slots.end (); ++j)
+        {
+          if (j->generation != 0 && now - j->generation <= GENERATIONS)
+            {
+              ++live;
+            }
+        }
+      uint32_t slots = MIN_SLOTS;
+      while (slots < 4 * live)
+        {
+          slots <<= 1;
+        }
+      Rehash (slots);
+    }
+  return false;
+}
+
+void
+DuplicateCache::Rehash (uint32_t slots)
+{
+  uint32_t now = GetGeneration ();
+  std::vector<Slot> old (slots, Slot ());
+  old.swap (m_slots);
+  m_used = 0;
+  uint32_t mask = slots - 1;
+  for (std::vector<Slot>::const_iterator j = old.begin (); j != old.end (); ++j)
+    {
+      if (j->generation == 0 || now - j->generation > GENERATIONS)
+        {
+          continue;
+        }
+      uint32_t i = Hash (j->addr, j->id) & mask;
+      while (m_slots[i].generation != 0)
+        {
+          i = (i + 1) & mask;
+        }
+      m_slots[i] = *j;
+      ++m_used;
+    }
+}
+
+//-----------------------------------------------------------------------------
+NeighborTable::NeighborTable ()
+  : m_nextId (0),
+    m_churn (0)
+{
+  m_txErrorCallback = MakeCallback (&NeighborTable::ProcessTxError, this);
+}
+
+Time
+NeighborTable::GetExpireTime (Ipv4Address addr)
+{
+  if (!IsNeighbor (addr))
+    {
+      return Seconds (0);
+    }
+  return m_nb.find (addr)->second.expireTime - Simulator::Now ();
+}
+
+bool
+NeighborTable::IsNeighbor (Ipv4Address addr)
+{
+  std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::const_iterator i = m_nb.find (addr);
+  if (i == m_nb.end ())
+    {
+      return false;
+    }
+  if (i->second.expireTime < Simulator::Now ())
+    {
+      Close (addr);
+      return false;
+    }
+  return true;
+}
+
+void
+NeighborTable::Update (Ipv4Address addr, Time expire)
+{
+  std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::iterator i = m_nb.find (addr);
+  if (i != m_nb.end ())
+    {
+      // The heap entry is brought up to date when it comes up
+      i->second.expireTime = std::max (expire + Simulator::Now (), i->second.expireTime);
+      if (i->second.hardwareAddress == Mac48Address ())
+        {
+          i->second.hardwareAddress = LookupMacAddress (addr);
+          IndexMac (addr, i->second.hardwareAddress);
+        }
+      return;
+    }
+
+  NS_LOG_LOGIC ("Open link to " << addr);
+  ++m_churn;
+  Neighbor neighbor;
+  neighbor.hardwareAddress = LookupMacAddress (addr);
+  neighbor.expireTime = expire + Simulator::Now ();
+  neighbor.id = m_nextId++;
+  m_nb[addr] = neighbor;
+  IndexMac (addr, neighbor.hardwareAddress);
+  Expiry expiry;
+  expiry.time = neighbor.expireTime;
+  expiry.addr = addr;
+  expiry.id = neighbor.id;
+  m_heap.push (expiry);
+  Purge ();
+}
+
+void
+NeighborTable::IndexMac (Ipv4Address addr, Mac48Address hardwareAddress)
+{
+  if (hardwareAddress != Mac48Address ())
+    {
+      m_macIndex.insert (std::make_pair (hardwareAddress, addr));
+    }
+}
+
+void
+NeighborTable::Close (Ipv4Address addr)
+{
+  std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::iterator i = m_nb.find (addr);
+  NS_ASSERT (i != m_nb.end ());
+  typedef std::multimap<Mac48Address, Ipv4Address>::iterator MacIterator;
+  std::pair<MacIterator, MacIterator> range = m_macIndex.equal_range (i->second.hardwareAddress);
+  for (MacIterator j = range.first; j != range.second; ++j)
+    {
+      if (j->second == addr)
+        {
+          m_macIndex.erase (j);
+          break;
+        }
+    }
+  m_nb.erase (i);
+  ++m_churn;
+  NS_LOG_LOGIC ("Close link to " << addr);
+  if (!m_handleLinkFailure.IsNull ())
+    {
+      m_handleLinkFailure (addr);
+    }
+}
+
+void
+NeighborTable::Purge ()
+{
+  Time now = Simulator::Now ();
+  while (!m_heap.empty () && m_heap.top ().time < now)
+    {
+      Expiry expiry = m_heap.top ();
+      m_heap.pop ();
+      std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::const_iterator i = m_nb.find (expiry.addr);
+      if (i == m_nb.end () || i->second.id != expiry.id)
+        {
+          continue;
+        }
+      if (i->second.expireTime >= now)
+        {
+          expiry.time = i->second.expireTime;
+          m_heap.push (expiry);
+          continue;
+        }
+      Close (expiry.addr);
+    }
+  if (!m_heap.empty ())
+    {
+      Arm (m_heap.top ().time);
+    }
+}
+
+void
+NeighborTable::Arm (Time t)
+{
+  if (m_event.IsRunning () && m_eventTime <= t)
+    {
+      return;
+    }
+  m_event.Cancel ();
+  m_eventTime = t;
+  // A neighbor expires once its expire time is in the past
+  m_event = Simulator::Schedule (t - Simulator::Now () + TimeStep (1), &NeighborTable::Purge, this);
+}
+
+void
+NeighborTable::Clear ()
+{
+  m_nb.clear ();
+  m_macIndex.clear ();
+  m_heap = std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry> > ();
+  m_event.Cancel ();
+  m_churn = 0;
+}
+
+void
+NeighborTable::AddArpCache (Ptr<ArpCache> a)
+{
+  m_arp.push_back (a);
+}
+
+void
+NeighborTable::DelArpCache (Ptr<ArpCache> a)
+{
+  m_arp.erase (std::remove (m_arp.begin (), m_arp.end (), a), m_arp.end ());
+}
+
+Mac48Address
+NeighborTable::LookupMacAddress (Ipv4Address addr)
+{
+  Mac48Address hwaddr;
+  for (std::vector<Ptr<ArpCache> >::const_iterator i = m_arp.begin ();
+       i != m_arp.end (); ++i)
+    {
+      ArpCache::Entry * entry = (*i)->Lookup (addr);
+      if (entry != 0 && (entry->IsAlive () || entry->IsPermanent ()) && !entry->IsExpired ())
+        {
+          hwaddr = Mac48Address::ConvertFrom (entry->GetMacAddress ());
+          break;
+        }
+    }
+  return hwaddr;
+}
+
+Ipv4Address
+NeighborTable::LookupIpAddress (Mac48Address hardwareAddress) const
+{
+  std::multimap<Mac48Address, Ipv4Address>::const_iterator i = m_macIndex.find (hardwareAddress);
+  for (; i != m_macIndex.end () && i->first == hardwareAddress; ++i)
+    {
+      // Index entries outlive the neighbors they were made for
+      std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash>::const_iterator j = m_nb.find (i->second);
+      if (j != m_nb.end () && j->second.hardwareAddress == hardwareAddress)
+        {
+          return i->second;
+        }
+    }
+  return Ipv4Address ();
+}
+
+void
+NeighborTable::ProcessTxError (WifiMacHeader const & hdr)
+{
+  Mac48Address addr = hdr.GetAddr1 ();
+  std::vector<Ipv4Address> failed;
+  typedef std::multimap<Mac48Address, Ipv4Address>::const_iterator MacIterator;
+  std::pair<MacIterator, MacIterator> range = m_macIndex.equal_range (addr);
+  for (MacIterator j = range.first; j != range.second; ++j)
+    {
+      failed.push_back (j->second);
+    }
+  for (std::vector<Ipv4Address>::const_iterator j = failed.begin (); j != failed.end (); ++j)
+    {
+      Close (*j);
+    }
+  Purge ();
+}
+
+//-----------------------------------------------------------------------------
+IndexedRoutingTable::IndexedRoutingTable (Time t)
+  : m_slots (MIN_SLOTS, Slot ()),
+    m_size (0),
+    m_badLinkLifetime (t)
+{
+}
+
+uint32_t
+IndexedRoutingTable::Hash (uint32_t dst)
+{
+  return static_cast<uint32_t> ((uint64_t (dst) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+uint32_t
+IndexedRoutingTable::FindSlot (Ipv4Address dst) const
+{
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t i = Hash (dst.Get ()) & mask;
+  while (m_slots[i].entry != 0 && m_slots[i].dst != dst.Get ())
+    {
+      i = (i + 1) & mask;
+    }
+  return i;
+}
+
+bool
+IndexedRoutingTable::Purge (uint32_t slot)
+{
+  RoutingTableEntry & rt = m_entries[m_slots[slot].entry - 1];
+  if (rt.GetLifeTime () >= Seconds (0))
+    {
+      return true;
+    }
+  if (rt.GetFlag () == INVALID)
+    {
+      Erase (slot);
+      return false;
+    }
+  if (rt.GetFlag () == VALID)
+    {
+      NS_LOG_LOGIC ("Invalidate route with destination address " << rt.GetDestination ());
+      rt.Invalidate (m_badLinkLifetime);
+    }
+  return true;
+}
+
+void
+IndexedRoutingTable::Erase (uint32_t slot)
+{
+  uint32_t entry = m_slots[slot].entry - 1;
+  m_entries[entry].m_ackTimer.Cancel ();
+  Unindex (m_entries[entry]);
+  m_entries[entry] = RoutingTableEntry ();
+  m_free.push_back (entry);
+  --m_size;
+  // Shift back the rest of the probe sequence so that no slot is left empty inside it
+  uint32_t mask = m_slots.size () - 1;
+  uint32_t hole = slot;
+  for (uint32_t j = (hole + 1) & mask; m_slots[j].entry != 0; j = (j + 1) & mask)
+    {
+      uint32_t home = Hash (m_slots[j].dst) & mask;
+      if (((j - home) & mask) >= ((j - hole) & mask))
+        {
+          m_slots[hole] = m_slots[j];
+          hole = j;
+        }
+    }
+  m_slots[hole] = Slot ();
+}
+
+void
+IndexedRoutingTable::Rehash (uint32_t slots)
+{
+  std::vector<Slot> old (slots, Slot ());
+  old.swap (m_slots);
+  uint32_t mask = slots - 1;
+  for (std::vector<Slot>::const_iterator j = old.begin (); j != old.end (); ++j)
+    {
+      if (j->entry == 0)
+        {
+          continue;
+        }
+      uint32_t i = Hash (j->dst) & mask;
+      while (m_slots[i].entry != 0)
+        {
+          i = (i + 1) & mask;
+        }
+      m_slots[i] = *j;
+    }
+}
+
+void
+IndexedRoutingTable::Index (RoutingTableEntry const & rt)
+{
+  m_nextHopIndex[rt.GetNextHop ()].insert (rt.GetDestination ());
+}
+
+void
+IndexedRoutingTable::Unindex (RoutingTableEntry const & rt)
+{
+  std::map<Ipv4Address, std::set<Ipv4Address> >::iterator i = m_nextHopIndex.find (rt.GetNextHop ());
+  if (i == m_nextHopIndex.end ())
+    {
+      return;
+    }
+  i->second.erase (rt.GetDestination ());
+  if (i->second.empty ())
+    {
+      m_nextHopIndex.erase (i);
+    }
+}
+
+bool
+IndexedRoutingTable::AddRoute (RoutingTableEntry & r)
+{
+  uint32_t slot = FindSlot (r.GetDestination ());
+  if (m_slots[slot].entry != 0 && Purge (slot))
+    {
+      return false;
+    }
+  if (2 * (m_size + 1) > m_slots.size ())
+    {
+      // Make room from expired routes before growing
+      Purge ();
+      uint32_t slots = MIN_SLOTS;
+      while (slots < 4 * (m_size + 1))
+        {
+          slots <<= 1;
+        }
+      if (slots != m_slots.size ())
+        {
+          Rehash (slots);
+        }
+    }
+  if (r.GetFlag () != IN_SEARCH)
+    {
+      r.SetRreqCnt (0);
+    }
+  uint32_t entry;
+  if (m_free.empty ())
+    {
+      entry = m_entries.size ();
+      m_entries.push_back (r);
+    }
+  else
+    {
+      entry = m_free.back ();
+      m_free.pop_back ();
+      m_entries[entry] = r;
+    }
+  slot = FindSlot (r.GetDestination ());
+  m_slots[slot].dst = r.GetDestination ().Get ();
+  m_slots[slot].entry = entry + 1;
+  ++m_size;
+  Index (r);
+  return true;
+}
+
+bool
+IndexedRoutingTable::DeleteRoute (Ipv4Address dst)
+{
+  uint32_t slot = FindSlot (dst);
+  if (m_slots[slot].entry == 0 || !Purge (slot))
+    {
+      return false;
+    }
+  Erase (slot);
+  return true;
+}
+
+RoutingTableEntry *
+IndexedRoutingTable::Find (Ipv4Address dst)
+{
+  uint32_t slot = FindSlot (dst);
+  if (m_slots[slot].entry == 0 || !Purge (slot))
+    {
+      return 0;
+    }
+  return &m_entries[m_slots[slot].entry - 1];
+}
+
+bool
+IndexedRoutingTable::LookupRoute (Ipv4Address dst, RoutingTableEntry & rt)
+{
+  RoutingTableEntry const * entry = Find (dst);
+  if (entry == 0)
+    {
+      return false;
+    }
+  rt = *entry;
+  return true;
+}
+
+bool
+IndexedRoutingTable::LookupValidRoute (Ipv4Address dst, RoutingTableEntry & rt)
+{
+  RoutingTableEntry const * entry = Find (dst);
+  if (entry == 0 || entry->GetFlag () != VALID)
+    {
+      return false;
+    }
+  rt = *entry;
+  return true;
+}
+
+bool
+IndexedRoutingTable::Update (RoutingTableEntry & rt)
+{
+  uint32_t slot = FindSlot (rt.GetDestination ());
+  if (m_slots[slot].entry == 0)
+    {
+      return false;
+    }
+  RoutingTableEntry & entry = m_entries[m_slots[slot].entry - 1];
+  if (entry.GetNextHop () != rt.GetNextHop ())
+    {
+      Unindex (entry);
+    }
+  entry = rt;
+  if (entry.GetFlag () != IN_SEARCH)
+    {
+      entry.SetRreqCnt (0);
+    }
+  Index (rt);
+  return true;
+}
+
+void
+IndexedRoutingTable::GetListOfDestinationWithNextHop (Ipv4Address nextHop, std::map<Ipv4Address, uint32_t> & unreachable)
+{
+  unreachable.clear ();
+  std::map<Ipv4Address, std::set<Ipv4Address> >::iterator i = m_nextHopIndex.find (nextHop);
+  if (i == m_nextHopIndex.end ())
+    {
+      return;
+    }
+  // Find purges only the route it looks at, but deleting an expired route also
+  // removes it from the index, so walk a copy
+  std::vector<Ipv4Address> dsts (i->second.begin (), i->second.end ());
+  for (std::vector<Ipv4Address>::const_iterator j = dsts.begin (); j != dsts.end (); ++j)
+    {
+      RoutingTableEntry const * rt = Find (*j);
+      if (rt != 0 && rt->GetNextHop () == nextHop)
+        {
+          unreachable.insert (std::make_pair (*j, rt->GetSeqNo ()));
+        }
+    }
+}
+
+void
+IndexedRoutingTable::InvalidateRoutesWithDst (const std::map<Ipv4Address, uint32_t> & unreachable)
+{
+  for (std::map<Ipv4Address, uint32_t>::const_iterator i = unreachable.begin ();
+       i != unreachable.end (); ++i)
+    {
+      RoutingTableEntry * rt = Find (i->first);
+      if (rt != 0 && rt->GetFlag () == VALID)
+        {
+          NS_LOG_LOGIC ("Invalidate route with destination address " << i->first);
+          rt->Invalidate (m_badLinkLifetime);
+        }
+    }
+}
+
+void
+IndexedRoutingTable::DeleteAllRoutesFromInterface (Ipv4InterfaceAddress iface)
+{
+  // Erase shifts later slots back, so the current slot is looked at again
+  for (uint32_t i = 0; i < m_slots.size (); )
+    {
+      if (m_slots[i].entry != 0 && m_entries[m_slots[i].entry - 1].GetInterface () == iface)
+        {
+          Erase (i);
+        }
+      else
+        {
+          ++i;
+        }
+    }
+}
+
+void
+IndexedRoutingTable::Clear ()
+{
+  m_entries.clear ();
+  m_free.clear ();
+  std::vector<Slot> (MIN_SLOTS, Slot ()).swap (m_slots);
+  m_size = 0;
+  m_nextHopIndex.clear ();
+}
+
+void
+IndexedRoutingTable::Purge ()
+{
+  for (uint32_t i = 0; i < m_slots.size (); )
+    {
+      if (m_slots[i].entry != 0 && !Purge (i))
+        {
+          continue;
+        }
+      ++i;
+    }
+}
+
+bool
+IndexedRoutingTable::MarkLinkAsUnidirectional (Ipv4Address neighbor, Time blacklistTimeout)
+{
+  uint32_t slot = FindSlot (neighbor);
+  if (m_slots[slot].entry == 0)
+    {
+      NS_LOG_LOGIC ("Mark link unidirectional to  " << neighbor << " fails; not found");
+      return false;
+    }
+  RoutingTableEntry & rt = m_entries[m_slots[slot].entry - 1];
+  rt.SetUnidirectional (true);
+  rt.SetBalcklistTimeout (blacklistTimeout);
+  rt.SetRreqCnt (0);
+  NS_LOG_LOGIC ("Set link to " << neighbor << " to unidirectional");
+  return true;
+}
+
+void
+IndexedRoutingTable::Print (Ptr<OutputStreamWrapper> stream) const
+{
+  // Print in address order, as the routes would have been purged
+  std::map<Ipv4Address, RoutingTableEntry> table;
+  for (std::vector<Slot>::const_iterator i = m_slots.begin (); i != m_slots.end (); ++i)
+    {
+      if (i->entry == 0)
+        {
+          continue;
+        }
+      RoutingTableEntry rt = m_entries[i->entry - 1];
+      if (rt.GetLifeTime () < Seconds (0))
+        {
+          if (rt.GetFlag () == INVALID)
+            {
+              continue;
+            }
+          if (rt.GetFlag () == VALID)
+            {
+              rt.Invalidate (m_badLinkLifetime);
+            }
+        }
+      table.insert (std::make_pair (rt.GetDestination (), rt));
+    }
+  *stream->GetStream () << "\nAODV Routing table\n"
+                        << "Destination\tGateway\t\tInterface\tFlag\tExpire\t\tHops\n";
+  for (std::map<Ipv4Address, RoutingTableEntry>::const_iterator i = table.begin (); i != table.end (); ++i)
+    {
+      i->second.Print (stream);
+    }
+  *stream->GetStream () << "\n";
+}
+
+//-----------------------------------------------------------------------------
+void
+AlternatePathCache::Add (Ipv4Address dst, Path const & path, uint32_t maxPaths)
+{
+  std::vector<Path> & paths = m_paths[dst];
+  // An expired path is replaced first, the longest live one otherwise
+  std::vector<Path>::iterator victim = paths.end ();
+  bool expired = false;
+  for (std::vector<Path>::iterator i = paths.begin (); i != paths.end (); ++i)
+    {
+      if (i->nextHop == path.nextHop)
+        {
+          *i = path;
+          return;
+        }
+      if (expired)
+        {
+          continue;
+        }
+      if (i->expire < Simulator::Now ())
+        {
+          victim = i;
+          expired = true;
+        }
+      else if (victim == paths.end () || i->hops > victim->hops)
+        {
+          victim = i;
+        }
+    }
+  if (paths.size () < maxPaths)
+    {
+      paths.push_back (path);
+    }
+  else if (victim != paths.end () && (expired || path.hops < victim->hops))
+    {
+      *victim = path;
+    }
+}
+
+bool
+AlternatePathCache::Pop (Ipv4Address dst, uint32_t seqNo, Path & path)
+{
+  std::map<Ipv4Address, std::vector<Path> >::iterator i = m_paths.find (dst);
+  if (i == m_paths.end ())
+    {
+      return false;
+    }
+  std::vector<Path> & paths = i->second;
+  std::vector<Path>::iterator best = paths.end ();
+  for (std::vector<Path>::iterator j = paths.begin (); j != paths.end (); )
+    {
+      if (j->seqNo != seqNo || j->expire < Simulator::Now ())
+        {
+          j = paths.erase (j);
+          continue;
+        }
+      if (best == paths.end () || j->hops < best->hops)
+        {
+          best = j;
+        }
+      ++j;
+    }
+  bool found = (best != paths.end ());
+  if (found)
+    {
+      path = *best;
+      paths.erase (best);
+    }
+  if (paths.empty ())
+    {
+      m_paths.erase (i);
+    }
+  return found;
+}
+
+void
+AlternatePathCache::Remove (Ipv4Address dst, Ipv4Address nextHop)
+{
+  std::map<Ipv4Address, std::vector<Path> >::iterator i = m_paths.find (dst);
+  if (i == m_paths.end ())
+    {
+      return;
+    }
+  for (std::vector<Path>::iterator j = i->second.begin (); j != i->second.end (); ++j)
+    {
+      if (j->nextHop == nextHop)
+        {
+          i->second.erase (j);
+          break;
+        }
+    }
+  if (i->second.empty ())
+    {
+      m_paths.erase (i);
+    }
+}
+
+void
+AlternatePathCache::RemoveNextHop (Ipv4Address nextHop)
+{
+  for (std::map<Ipv4Address, std::vector<Path> >::iterator i = m_paths.begin (); i != m_paths.end (); )
+    {
+      Remove ((i++)->first, nextHop);
+    }
+}
 
 //-----------------------------------------------------------------------------
 RoutingProtocol::RoutingProtocol ()
@@ -162,18 +1267,46 @@ RoutingProtocol::RoutingProtocol ()
     m_destinationOnly (false),
     m_gratuitousReply (true),
     m_enableHello (false),
+    m_enableAggregation (false),
+    m_maxAggregateSize (512),
+    m_gossipProbability (1.0),
+    m_rreqCounterThreshold (0),
+    m_enableLocalRepair (false),
+    m_maxRepairTtl (10),
+    m_localAddTtl (2),
+    m_enableMultipath (false),
+    m_maxPaths (3),
+    m_enableLoadBalancing (false),
+    m_loadHopSlack (1),
+    m_enableRouteRefresh (false),
+    m_routeRefreshLead (MilliSeconds (500)),
+    m_signalFadeThreshold (3.0),
+    m_enableLinkQuality (false),
+    m_weakLinkSnr (10.0),
+    m_weakLinkRreqDelay (MilliSeconds (20)),
+    m_enablePassiveLearning (false),
+    m_passiveRouteLifetime (Seconds (2)),
+    m_enableHopHistory (false),
+    m_hopHistoryLifetime (Seconds (30)),
+    m_enableAdaptiveHello (false),
+    m_minHelloInterval (MilliSeconds (500)),
+    m_maxHelloInterval (Seconds (4)),
+    m_enableChannelStriping (false),
+    m_channelStripingDelay (MilliSeconds (10)),
     m_routingTable (m_deletePeriod),
     m_queue (m_maxQueueLen, m_maxQueueTime),
     m_requestId (0),
     m_seqNo (0),
     m_rreqIdCache (m_pathDiscoveryTime),
     m_dpd (m_pathDiscoveryTime),
-    m_nb (m_helloInterval),
-    m_rreqCount (0),
-    m_rerrCount (0),
+    m_jitterId (0),
+    m_forwardRate (0),
+    m_forwardCount (0),
+    m_forwardWindowStart (Seconds (0)),
+    m_defaultTtl (64),
     m_htimer (Timer::CANCEL_ON_DESTROY),
-    m_rreqRateLimitTimer (Timer::CANCEL_ON_DESTROY),
-    m_rerrRateLimitTimer (Timer::CANCEL_ON_DESTROY),
+    m_currentHelloInterval (Seconds (1)),
+    m_timerWheel (MilliSeconds (1)),
     m_lastBcastTime (Seconds (0))
 {
   m_nb.SetCallback (MakeCallback (&RoutingProtocol::SendRerrWhenBreaksLinkToNextHop, this));
@@ -212,11 +1345,13 @@ RoutingProtocol::GetTypeId (void)
                    MakeUintegerChecker<uint32_t> ())
     .AddAttribute ("RreqRateLimit", "Maximum number of RREQ per second.",
                    UintegerValue (10),
-                   MakeUintegerAccessor (&RoutingProtocol::m_rreqRateLimit),
+                   MakeUintegerAccessor (&RoutingProtocol::SetRreqRateLimit,
+                                         &RoutingProtocol::GetRreqRateLimit),
                    MakeUintegerChecker<uint32_t> ())
     .AddAttribute ("RerrRateLimit", "Maximum number of RERR per second.",
                    UintegerValue (10),
-                   MakeUintegerAccessor (&RoutingProtocol::m_rerrRateLimit),
+                   MakeUintegerAccessor (&RoutingProtocol::SetRerrRateLimit,
+                                         &RoutingProtocol::GetRerrRateLimit),
                    MakeUintegerChecker<uint32_t> ())
     .AddAttribute ("NodeTraversalTime", "Conservative estimate of the average one hop traversal time for packets and should include "
                    "queuing delays, interrupt processing times and transfer times.",
@@ -291,6 +1426,124 @@ RoutingProtocol::GetTypeId (void)
                    MakeBooleanAccessor (&RoutingProtocol::SetBroadcastEnable,
                                         &RoutingProtocol::GetBroadcastEnable),
                    MakeBooleanChecker ())
+    .AddAttribute ("EnableAggregation", "Indicates whether control messages released at the same time on the same interface for the same destination "
+                   "are sent in one datagram.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableAggregation),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MaxAggregateSize", "Maximum size in bytes of a datagram carrying aggregated control messages.",
+                   UintegerValue (512),
+                   MakeUintegerAccessor (&RoutingProtocol::m_maxAggregateSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("GossipProbability", "Probability with which a RREQ that is neither answered nor out of TTL is rebroadcast.",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&RoutingProtocol::m_gossipProbability),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("RreqCounterThreshold", "Number of copies of a RREQ heard during the rebroadcast jitter after which "
+                   "the rebroadcast is cancelled; 0 disables the counter-based suppression.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&RoutingProtocol::m_rreqCounterThreshold),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("EnableLocalRepair", "Indicates whether a node repairs the routes broken at its next hop before reporting them with RERR.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableLocalRepair),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MaxRepairTtl", "Maximum hop count of a route to be repaired locally.",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&RoutingProtocol::m_maxRepairTtl),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("LocalAddTtl", "Hops added to the last known hop count for the TTL of a local repair RREQ.",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&RoutingProtocol::m_localAddTtl),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("EnableMultipath", "Indicates whether alternate next hops learned from duplicate RREQs and RREPs "
+                   "are kept and used when the link to the next hop of a route breaks.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableMultipath),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MaxPaths", "Maximum number of alternate next hops kept per destination.",
+                   UintegerValue (3),
+                   MakeUintegerAccessor (&RoutingProtocol::m_maxPaths),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("EnableLoadBalancing", "Indicates whether RREQ and RREP carry the load of the relays they go through "
+                   "and paths through lightly loaded relays are preferred.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableLoadBalancing),
+                   MakeBooleanChecker ())
+    .AddAttribute ("LoadHopSlack", "Extra hops a lighter path may have over the shortest one to be preferred.",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&RoutingProtocol::m_loadHopSlack),
+                   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("EnableRouteRefresh", "Indicates whether the routes of flows originated by this node are "
+                   "rediscovered in the background before they or the link to their next hop expire, or when the next hop fades.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableRouteRefresh),
+                   MakeBooleanChecker ())
+    .AddAttribute ("RouteRefreshLead", "How long before an active route or the link to its next hop expires its background discovery "
+                   "starts. At most RreqRetries background discoveries are made between two RREPs for the destination.",
+                   TimeValue (MilliSeconds (500)),
+                   MakeTimeAccessor (&RoutingProtocol::m_routeRefreshLead),
+                   MakeTimeChecker ())
+    .AddAttribute ("SignalFadeThreshold", "Drop, in dB, of the recent receive SNR from the next hop below "
+                   "its long-term average that triggers a background discovery.",
+                   DoubleValue (3.0),
+                   MakeDoubleAccessor (&RoutingProtocol::m_signalFadeThreshold),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("EnableLinkQuality", "Indicates whether links with a low average receive SNR are avoided "
+                   "when processing RREQ and RREP messages.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableLinkQuality),
+                   MakeBooleanChecker ())
+    .AddAttribute ("WeakLinkSnr", "Average receive SNR, in dB, below which a link is weak.",
+                   DoubleValue (10.0),
+                   MakeDoubleAccessor (&RoutingProtocol::m_weakLinkSnr),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("WeakLinkRreqDelay", "Delay before a RREQ received over a weak link is processed, "
+                   "giving copies received over strong links the chance to be processed first.",
+                   TimeValue (MilliSeconds (20)),
+                   MakeTimeAccessor (&RoutingProtocol::m_weakLinkRreqDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("EnablePassiveLearning", "Indicates whether routes are learned from RREPs and data packets "
+                   "overheard between other nodes, and used instead of a route discovery.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enablePassiveLearning),
+                   MakeBooleanChecker ())
+    .AddAttribute ("PassiveRouteLifetime", "Lifetime of a route learned from overheard packets.",
+                   TimeValue (Seconds (2)),
+                   MakeTimeAccessor (&RoutingProtocol::m_passiveRouteLifetime),
+                   MakeTimeChecker ())
+    .AddAttribute ("EnableHopHistory", "Indicates whether the last known hop count to a destination, kept after "
+                   "its route is deleted, seeds the TTL of the expanding ring search for it.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableHopHistory),
+                   MakeBooleanChecker ())
+    .AddAttribute ("HopHistoryLifetime", "How long the last known hop count to a destination is remembered.",
+                   TimeValue (Seconds (30)),
+                   MakeTimeAccessor (&RoutingProtocol::m_hopHistoryLifetime),
+                   MakeTimeChecker ())
+    .AddAttribute ("EnableAdaptiveHello", "Indicates whether the hello interval is stretched while the neighbors are stable, "
+                   "and shortened while they join and leave.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableAdaptiveHello),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MinHelloInterval", "Shortest hello interval in adaptive mode.",
+                   TimeValue (MilliSeconds (500)),
+                   MakeTimeAccessor (&RoutingProtocol::m_minHelloInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxHelloInterval", "Longest hello interval in adaptive mode.",
+                   TimeValue (Seconds (4)),
+                   MakeTimeAccessor (&RoutingProtocol::m_maxHelloInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("EnableChannelStriping", "Indicates whether a node with several interfaces delays the rebroadcast of a RREQ "
+                   "on the interface it arrived on, so that discovered paths alternate channels, and drops that rebroadcast "
+                   "once a duplicate is heard there.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&RoutingProtocol::m_enableChannelStriping),
+                   MakeBooleanChecker ())
+    .AddAttribute ("ChannelStripingDelay", "Extra delay of the RREQ rebroadcast on the interface the RREQ arrived on.",
+                   TimeValue (MilliSeconds (10)),
+                   MakeTimeAccessor (&RoutingProtocol::m_channelStripingDelay),
+                   MakeTimeChecker ())
     .AddAttribute ("UniformRv",
                    "Access to the underlying UniformRandomVariable",
                    StringValue ("ns3::UniformRandomVariable"),
@@ -302,6 +1555,9 @@ RoutingProtocol::GetTypeId (void)
     .AddTraceSource ("Rx", "A new routing protocol packet is received", // trace
                      MakeTraceSourceAccessor (&RoutingProtocol::m_rxTrace),
                      "ns3::Packet::TracedCallback")
+    .AddTraceSource ("LocalRepair", "A local repair has ended, with its destination, outcome and latency",
+                     MakeTraceSourceAccessor (&RoutingProtocol::m_localRepairTrace),
+                     "ns3::aodv::RoutingProtocol::LocalRepairTracedCallback")
   ;
   return tid;
 }
@@ -312,6 +1568,21 @@ RoutingProtocol::SetMaxQueueLen (uint32_t len)
   m_maxQueueLen = len;
   m_queue.SetMaxQueueLen (len);
 }
+
+void
+RoutingProtocol::SetRreqRateLimit (uint32_t rate)
+{
+  m_rreqRateLimit = rate;
+  m_rreqRateLimiter.SetRate (rate);
+}
+
+void
+RoutingProtocol::SetRerrRateLimit (uint32_t rate)
+{
+  m_rerrRateLimit = rate;
+  m_rerrRateLimiter.SetRate (rate);
+}
+
 void
 RoutingProtocol::SetMaxQueueTime (Time t)
 {
@@ -339,6 +1610,36 @@ RoutingProtocol::DoDispose ()
       iter->first->Close ();
     }
   m_socketSubnetBroadcastAddresses.clear ();
+  UpdateInterfaceCache ();
+  m_timerWheel.Clear ();
+  m_addressReqTimer.clear ();
+  m_pendingRreqEvent.Cancel ();
+  m_pendingRreq.clear ();
+  m_nb.Clear ();
+  m_rreqForwards.clear ();
+  m_rreqForwardTimes.clear ();
+  m_localRepairs.clear ();
+  m_alternatePaths.Clear ();
+  m_rreqAnswers.clear ();
+  m_rreqAnswerTimes.clear ();
+  m_routeLoad.clear ();
+  m_activeFlows.clear ();
+  m_linkSignal.clear ();
+  for (std::deque<EventId>::iterator i = m_weakRreqEvents.begin (); i != m_weakRreqEvents.end (); ++i)
+    {
+      i->Cancel ();
+    }
+  m_weakRreqEvents.clear ();
+  m_passiveRoutes.clear ();
+  m_unconfirmedRoutes.clear ();
+  m_hopHistory.clear ();
+  m_hopHistoryTimes.clear ();
+  Ptr<Node> node = GetObject<Node> ();
+  if (!m_promiscDevices.empty () && node != 0)
+    {
+      node->UnregisterProtocolHandler (MakeCallback (&RoutingProtocol::PromiscuousRx, this));
+    }
+  m_promiscDevices.clear ();
   Ipv4RoutingProtocol::DoDispose ();
 }
 
@@ -366,18 +1667,8 @@ void
 RoutingProtocol::Start ()
 {
   NS_LOG_FUNCTION (this);
-  if (m_enableHello)
-    {
-      m_nb.ScheduleTimer ();
-    }
-  m_rreqRateLimitTimer.SetFunction (&RoutingProtocol::RreqRateLimitTimerExpire,
-                                    this);
-  m_rreqRateLimitTimer.Schedule (Seconds (1));
-
-  m_rerrRateLimitTimer.SetFunction (&RoutingProtocol::RerrRateLimitTimerExpire,
-                                    this);
-  m_rerrRateLimitTimer.Schedule (Seconds (1));
-
+  m_rreqRateLimiter.SetRate (m_rreqRateLimit);
+  m_rerrRateLimiter.SetRate (m_rerrRateLimit);
 }
 
 Ptr<Ipv4Route>
@@ -400,10 +1691,10 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p, const Ipv4Header &header,
   sockerr = Socket::ERROR_NOTERROR;
   Ptr<Ipv4Route> route;
   Ipv4Address dst = header.GetDestination ();
-  RoutingTableEntry rt;
-  if (m_routingTable.LookupValidRoute (dst, rt))
+  RoutingTableEntry const * rt = m_routingTable.Find (dst);
+  if (rt != 0 && rt->GetFlag () == VALID)
     {
-      route = rt.GetRoute ();
+      route = rt->GetRoute ();
       NS_ASSERT (route != 0);
       NS_LOG_DEBUG ("Exist route to " << route->GetDestination () << " from interface " << route->GetSource ());
       if (oif != 0 && route->GetOutputDevice () != oif)
@@ -414,6 +1705,10 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p, const Ipv4Header &header,
         }
       UpdateRouteLifeTime (dst, m_activeRouteTimeout);
       UpdateRouteLifeTime (route->GetGateway (), m_activeRouteTimeout);
+      if (m_enableRouteRefresh)
+        {
+          NoteActiveFlow (dst);
+        }
       return route;
     }
 
@@ -430,6 +1725,202 @@ RoutingProtocol::RouteOutput (Ptr<Packet> p, const Ipv4Header &header,
   return LoopbackRoute (header, oif);
 }
 
+void
+RoutingProtocol::PromiscuousRx (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol,
+                                const Address &from, const Address &to, NetDevice::PacketType packetType)
+{
+  if (packetType != NetDevice::PACKET_OTHERHOST)
+    {
+      // Packets to this node are routed as usual
+      return;
+    }
+  int32_t interface = m_ipv4->GetInterfaceForDevice (device);
+  if (interface < 0 || !m_ipv4->IsUp (interface))
+    {
+      return;
+    }
+  Ipv4InterfaceAddress iface = m_ipv4->GetAddress (interface, 0);
+  Ptr<Packet> p = packet->Copy ();
+  Ipv4Header ipHeader;
+  if (p->GetSize () < ipHeader.GetSerializedSize ())
+    {
+      return;
+    }
+  p->RemoveHeader (ipHeader);
+  Ipv4Address src = ipHeader.GetSource ();
+  Ipv4Address dst = ipHeader.GetDestination ();
+  if (ipHeader.GetFragmentOffset () != 0 || IsMyOwnAddress (src) || IsMyOwnAddress (dst))
+    {
+      return;
+    }
+
+  UdpHeader udpHeader;
+  if (ipHeader.GetProtocol () == UdpL4Protocol::PROT_NUMBER && p->GetSize () >= udpHeader.GetSerializedSize ())
+    {
+      p->PeekHeader (udpHeader);
+      if (udpHeader.GetDestinationPort () == AODV_PORT)
+        {
+          // A RREP tells the hop count and the lifetime of the route through its transmitter
+          p->RemoveHeader (udpHeader);
+          while (p->GetSize () > 0)
+            {
+              TypeHeader tHeader (AODVTYPE_RREQ);
+              Ptr<Packet> message = RemoveMessage (p, tHeader);
+              if (!message)
+                {
+                  return;
+                }
+              if (tHeader.Get () != AODVTYPE_RREP)
+                {
+                  continue;
+                }
+              RrepHeader rrepHeader;
+              message->RemoveHeader (rrepHeader);
+              if (!IsMyOwnAddress (rrepHeader.GetDst ()))
+                {
+                  LearnPassiveRoute (rrepHeader.GetDst (), src, device, iface, rrepHeader.GetHopCount () + 1,
+                                     std::min (m_passiveRouteLifetime, rrepHeader.GetLifeTime ()));
+                }
+            }
+          return;
+        }
+    }
+
+  // A forwarded data packet tells that its transmitter has routes to both ends
+  if (!Mac48Address::IsMatchingType (from) || dst.IsBroadcast () || dst.IsMulticast ())
+    {
+      return;
+    }
+  Ipv4Address transmitter = m_nb.LookupIpAddress (Mac48Address::ConvertFrom (from));
+  if (transmitter == Ipv4Address ())
+    {
+      return;
+    }
+  if (ipHeader.GetTtl () <= m_defaultTtl)
+    {
+      LearnPassiveRoute (src, transmitter, device, iface, m_defaultTtl - ipHeader.GetTtl () + 1, m_passiveRouteLifetime);
+    }
+  // The hop count from the transmitter to dst is unknown
+  LearnPassiveRoute (dst, transmitter, device, iface, 0, m_passiveRouteLifetime);
+}
+
+void
+RoutingProtocol::LearnPassiveRoute (Ipv4Address dst, Ipv4Address nextHop, Ptr<NetDevice> device,
+                                    Ipv4InterfaceAddress iface, uint16_t hops, Time lifetime)
+{
+  std::map<Ipv4Address, PassiveRoute>::iterator i = m_passiveRoutes.find (dst);
+  if (i != m_passiveRoutes.end () && i->second.expire >= Simulator::Now () && i->second.hops != 0
+      && (hops == 0 || i->second.hops < hops))
+    {
+      return;
+    }
+  PassiveRoute & route = m_passiveRoutes[dst];
+  route.nextHop = nextHop;
+  route.device = device;
+  route.iface = iface;
+  route.hops = hops;
+  route.expire = Simulator::Now () + lifetime;
+}
+
+void
+RoutingProtocol::RecordHopCount (Ipv4Address dst, uint16_t hops)
+{
+  if (!m_enableHopHistory)
+    {
+      return;
+    }
+  while (!m_hopHistoryTimes.empty () && m_hopHistoryTimes.front ().first + m_hopHistoryLifetime < Simulator::Now ())
+    {
+      // An entry learned again since is found by its newer time
+      std::map<Ipv4Address, std::pair<uint16_t, Time> >::iterator i = m_hopHistory.find (m_hopHistoryTimes.front ().second);
+      if (i != m_hopHistory.end () && i->second.second == m_hopHistoryTimes.front ().first)
+        {
+          m_hopHistory.erase (i);
+        }
+      m_hopHistoryTimes.pop_front ();
+    }
+  std::pair<uint16_t, Time> & entry = m_hopHistory[dst];
+  if (entry.second == Simulator::Now () && entry.first == hops)
+    {
+      return;
+    }
+  entry = std::make_pair (hops, Simulator::Now ());
+  m_hopHistoryTimes.push_back (std::make_pair (Simulator::Now (), dst));
+}
+
+bool
+RoutingProtocol::LookupHopCount (Ipv4Address dst, uint16_t & hops)
+{
+  if (!m_enableHopHistory)
+    {
+      return false;
+    }
+  std::map<Ipv4Address, std::pair<uint16_t, Time> >::const_iterator i = m_hopHistory.find (dst);
+  if (i == m_hopHistory.end () || i->second.second + m_hopHistoryLifetime < Simulator::Now ())
+    {
+      return false;
+    }
+  hops = i->second.first;
+  return true;
+}
+
+bool
+RoutingProtocol::UsePassiveRoute (Ipv4Address dst)
+{
+  if (!m_enablePassiveLearning)
+    {
+      return false;
+    }
+  std::map<Ipv4Address, PassiveRoute>::iterator i = m_passiveRoutes.find (dst);
+  if (i == m_passiveRoutes.end ())
+    {
+      return false;
+    }
+  PassiveRoute route = i->second;
+  m_passiveRoutes.erase (i);
+  // The neighbor must have been heard lately and the interface must still be up
+  int32_t interface = m_ipv4->GetInterfaceForDevice (route.device);
+  if (route.expire < Simulator::Now () || interface < 0 || !m_ipv4->IsUp (interface)
+      || !(m_ipv4->GetAddress (interface, 0) == route.iface))
+    {
+      return false;
+    }
+  NS_LOG_DEBUG ("Use overheard route to " << dst << " through " << route.nextHop << " instead of a RREQ");
+  UpdateRouteToNeighbor (route.nextHop, route.iface.GetLocal ());
+  // The entry has no valid sequence number, so it never answers a RREQ and the first RREP heard for dst replaces it
+  UnconfirmedRoute & unconfirmed = m_unconfirmedRoutes[dst];
+  unconfirmed.hopsKnown = (route.hops != 0);
+  unconfirmed.validSeqNo = false;
+  unconfirmed.seqNo = 0;
+  uint16_t hops = (route.hops != 0) ? route.hops : m_netDiameter;
+  RoutingTableEntry rt;
+  if (m_routingTable.LookupRoute (dst, rt))
+    {
+      // Keep the precursors, and the sequence number for the RREQs of this node
+      if (rt.GetValidSeqNo ())
+        {
+          unconfirmed.validSeqNo = true;
+          unconfirmed.seqNo = rt.GetSeqNo ();
+        }
+      rt.SetValidSeqNo (false);
+      rt.SetNextHop (route.nextHop);
+      rt.SetOutputDevice (route.device);
+      rt.SetInterface (route.iface);
+      rt.SetHop (hops);
+      rt.SetLifeTime (route.expire - Simulator::Now ());
+      rt.SetFlag (VALID);
+      m_routingTable.Update (rt);
+    }
+  else
+    {
+      RoutingTableEntry newEntry (/*device=*/ route.device, /*dst=*/ dst, /*validSeqNo=*/ false, /*seqno=*/ 0,
+                                              /*iface=*/ route.iface, /*hops=*/ hops,
+                                              /*nextHop=*/ route.nextHop, /*lifetime=*/ route.expire - Simulator::Now ());
+      m_routingTable.AddRoute (newEntry);
+    }
+  return true;
+}
+
 void
 RoutingProtocol::DeferredRouteOutput (Ptr<const Packet> p, const Ipv4Header & header,
                                       UnicastForwardCallback ucb, ErrorCallback ecb)
@@ -446,6 +1937,12 @@ RoutingProtocol::DeferredRouteOutput (Ptr<const Packet> p, const Ipv4Header & he
       bool result = m_routingTable.LookupRoute (header.GetDestination (), rt);
       if (!result || ((rt.GetFlag () != IN_SEARCH) && result))
         {
+          if (UsePassiveRoute (header.GetDestination ()))
+            {
+              m_routingTable.LookupRoute (header.GetDestination (), rt);
+              SendPacketFromQueue (header.GetDestination (), rt.GetRoute ());
+              return;
+            }
           NS_LOG_LOGIC ("Send new RREQ for outbound packet to " << header.GetDestination ());
           SendRequest (header.GetDestination ());
         }
@@ -496,66 +1993,62 @@ RoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
     }
 
   // Broadcast local delivery/forwarding
-  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
-         m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
+  if (iif < (int32_t) m_interfaceCache.size () && m_interfaceCache[iif].socket)
     {
-      Ipv4InterfaceAddress iface = j->second;
-      if (m_ipv4->GetInterfaceForAddress (iface.GetLocal ()) == iif)
+      Ipv4InterfaceAddress iface = m_interfaceCache[iif].iface;
+      if (dst == iface.GetBroadcast () || dst.IsBroadcast ())
         {
-          if (dst == iface.GetBroadcast () || dst.IsBroadcast ())
+          if (m_dpd.IsDuplicate (p, header))
             {
-              if (m_dpd.IsDuplicate (p, header))
-                {
-                  NS_LOG_DEBUG ("Duplicated packet " << p->GetUid () << " from " << origin << ". Drop.");
-                  return true;
-                }
-              UpdateRouteLifeTime (origin, m_activeRouteTimeout);
-              Ptr<Packet> packet = p->Copy ();
-              if (lcb.IsNull () == false)
-                {
-                  NS_LOG_LOGIC ("Broadcast local delivery to " << iface.GetLocal ());
-                  lcb (p, header, iif);
-                  // Fall through to additional processing
-                }
-              else
-                {
-                  NS_LOG_ERROR ("Unable to deliver packet locally due to null callback " << p->GetUid () << " from " << origin);
-                  ecb (p, header, Socket::ERROR_NOROUTETOHOST);
-                }
-              if (!m_enableBroadcast)
+              NS_LOG_DEBUG ("Duplicated packet " << p->GetUid () << " from " << origin << ". Drop.");
+              return true;
+            }
+          UpdateRouteLifeTime (origin, m_activeRouteTimeout);
+          Ptr<Packet> packet = p->Copy ();
+          if (lcb.IsNull () == false)
+            {
+              NS_LOG_LOGIC ("Broadcast local delivery to " << iface.GetLocal ());
+              lcb (p, header, iif);
+              // Fall through to additional processing
+            }
+          else
+            {
+              NS_LOG_ERROR ("Unable to deliver packet locally due to null callback " << p->GetUid () << " from " << origin);
+              ecb (p, header, Socket::ERROR_NOROUTETOHOST);
+            }
+          if (!m_enableBroadcast)
+            {
+              return true;
+            }
+          if (header.GetProtocol () == UdpL4Protocol::PROT_NUMBER)
+            {
+              UdpHeader udpHeader;
+              p->PeekHeader (udpHeader);
+              if (udpHeader.GetDestinationPort () == AODV_PORT)
                 {
+                  // AODV packets sent in broadcast are already managed
                   return true;
                 }
-              if (header.GetProtocol () == UdpL4Protocol::PROT_NUMBER)
-                {
-                  UdpHeader udpHeader;
-                  p->PeekHeader (udpHeader);
-                  if (udpHeader.GetDestinationPort () == AODV_PORT)
-                    {
-                      // AODV packets sent in broadcast are already managed
-                      return true;
-                    }
-                }
-              if (header.GetTtl () > 1)
+            }
+          if (header.GetTtl () > 1)
+            {
+              NS_LOG_LOGIC ("Forward broadcast. TTL " << (uint16_t) header.GetTtl ());
+              RoutingTableEntry toBroadcast;
+              if (m_routingTable.LookupRoute (dst, toBroadcast))
                 {
-                  NS_LOG_LOGIC ("Forward broadcast. TTL " << (uint16_t) header.GetTtl ());
-                  RoutingTableEntry toBroadcast;
-                  if (m_routingTable.LookupRoute (dst, toBroadcast))
-                    {
-                      Ptr<Ipv4Route> route = toBroadcast.GetRoute ();
-                      ucb (route, packet, header);
-                    }
-                  else
-                    {
-                      NS_LOG_DEBUG ("No route to forward broadcast. Drop packet " << p->GetUid ());
-                    }
+                  Ptr<Ipv4Route> route = toBroadcast.GetRoute ();
+                  ucb (route, packet, header);
                 }
               else
                 {
-                  NS_LOG_DEBUG ("TTL exceeded. Drop packet " << p->GetUid ());
+                  NS_LOG_DEBUG ("No route to forward broadcast. Drop packet " << p->GetUid ());
                 }
-              return true;
             }
+          else
+            {
+              NS_LOG_DEBUG ("TTL exceeded. Drop packet " << p->GetUid ());
+            }
+          return true;
         }
     }
 
@@ -563,11 +2056,12 @@ RoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
   if (m_ipv4->IsDestinationAddress (dst, iif))
     {
       UpdateRouteLifeTime (origin, m_activeRouteTimeout);
-      RoutingTableEntry toOrigin;
-      if (m_routingTable.LookupValidRoute (origin, toOrigin))
+      RoutingTableEntry const * toOrigin = m_routingTable.Find (origin);
+      if (toOrigin != 0 && toOrigin->GetFlag () == VALID)
         {
-          UpdateRouteLifeTime (toOrigin.GetNextHop (), m_activeRouteTimeout);
-          m_nb.Update (toOrigin.GetNextHop (), m_activeRouteTimeout);
+          Ipv4Address nextHop = toOrigin->GetNextHop ();
+          UpdateRouteLifeTime (nextHop, m_activeRouteTimeout);
+          m_nb.Update (nextHop, m_activeRouteTimeout);
         }
       if (lcb.IsNull () == false)
         {
@@ -591,23 +2085,22 @@ RoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
     }
 
   // Forwarding
-  return Forwarding (p, header, ucb, ecb);
+  return Forwarding (p, header, ucb, ecb, iif);
 }
 
 bool
 RoutingProtocol::Forwarding (Ptr<const Packet> p, const Ipv4Header & header,
-                             UnicastForwardCallback ucb, ErrorCallback ecb)
+                             UnicastForwardCallback ucb, ErrorCallback ecb, int32_t iif)
 {
   NS_LOG_FUNCTION (this);
   Ipv4Address dst = header.GetDestination ();
   Ipv4Address origin = header.GetSource ();
-  m_routingTable.Purge ();
-  RoutingTableEntry toDst;
-  if (m_routingTable.LookupRoute (dst, toDst))
+  RoutingTableEntry const * toDst = m_routingTable.Find (dst);
+  if (toDst != 0)
     {
-      if (toDst.GetFlag () == VALID)
+      if (toDst->GetFlag () == VALID)
         {
-          Ptr<Ipv4Route> route = toDst.GetRoute ();
+          Ptr<Ipv4Route> route = toDst->GetRoute ();
           NS_LOG_LOGIC (route->GetSource () << " forwarding to " << dst << " from " << origin << " packet " << p->GetUid ());
 
           /*
@@ -624,21 +2117,40 @@ RoutingProtocol::Forwarding (Ptr<const Packet> p, const Ipv4Header & header,
            *  Active Route Lifetime for the previous hop, along the reverse path back to the IP source, is also updated
            *  to be no less than the current time plus ActiveRouteTimeout
            */
-          RoutingTableEntry toOrigin;
-          m_routingTable.LookupRoute (origin, toOrigin);
-          UpdateRouteLifeTime (toOrigin.GetNextHop (), m_activeRouteTimeout);
+          RoutingTableEntry const * toOrigin = m_routingTable.Find (origin);
+          Ipv4Address prevHop = toOrigin ? toOrigin->GetNextHop () : Ipv4Address ();
+          UpdateRouteLifeTime (prevHop, m_activeRouteTimeout);
 
           m_nb.Update (route->GetGateway (), m_activeRouteTimeout);
-          m_nb.Update (toOrigin.GetNextHop (), m_activeRouteTimeout);
+          m_nb.Update (prevHop, m_activeRouteTimeout);
 
+          if (m_enableLoadBalancing)
+            {
+              UpdateForwardRate ();
+              ++m_forwardCount;
+            }
           ucb (route, p, header);
           return true;
         }
+      else if (toDst->GetFlag () == IN_SEARCH && m_localRepairs.find (dst) != m_localRepairs.end ())
+        {
+          NS_LOG_LOGIC ("Buffer packet " << p->GetUid () << " during the local repair of the route to " << dst);
+          QueueEntry newEntry (p, header, ucb, ecb);
+          if (!m_queue.Enqueue (newEntry))
+            {
+              NS_LOG_DEBUG ("Buffer full, drop packet " << p->GetUid ());
+            }
+          return true;
+        }
+      else if (SwitchToAlternatePath (dst))
+        {
+          return Forwarding (p, header, ucb, ecb, iif);
+        }
       else
         {
-          if (toDst.GetValidSeqNo ())
+          if (toDst->GetValidSeqNo ())
             {
-              SendRerrWhenNoRouteToForward (dst, toDst.GetSeqNo (), origin);
+              SendRerrWhenNoRouteToForward (dst, toDst->GetSeqNo (), origin, iif);
               NS_LOG_DEBUG ("Drop packet " << p->GetUid () << " because no route to forward it.");
               return false;
             }
@@ -646,7 +2158,7 @@ RoutingProtocol::Forwarding (Ptr<const Packet> p, const Ipv4Header & header,
     }
   NS_LOG_LOGIC ("route not found to " << dst << ". Send RERR message.");
   NS_LOG_DEBUG ("Drop packet " << p->GetUid () << " because no route to forward it.");
-  SendRerrWhenNoRouteToForward (dst, 0, origin);
+  SendRerrWhenNoRouteToForward (dst, 0, origin, iif);
   return false;
 }
 
@@ -708,9 +2220,10 @@ RoutingProtocol::NotifyInterfaceUp (uint32_t i)
   socket->SetAllowBroadcast (true);
   socket->SetIpRecvTtl (true);
   m_socketSubnetBroadcastAddresses.insert (std::make_pair (socket, iface));
+  UpdateInterfaceCache ();
 
   // Add local broadcast record to the routing table
-  Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (iface.GetLocal ()));
+  Ptr<NetDevice> dev = m_ipv4->GetNetDevice (i);
   RoutingTableEntry rt (/*device=*/ dev, /*dst=*/ iface.GetBroadcast (), /*know seqno=*/ true, /*seqno=*/ 0, /*iface=*/ iface,
                                     /*hops=*/ 1, /*next hop=*/ iface.GetBroadcast (), /*lifetime=*/ Simulator::GetMaximumSimulationTime ());
   m_routingTable.AddRoute (rt);
@@ -720,6 +2233,15 @@ RoutingProtocol::NotifyInterfaceUp (uint32_t i)
       m_nb.AddArpCache (l3->GetInterface (i)->GetArpCache ());
     }
 
+  if (m_enablePassiveLearning && m_promiscDevices.insert (dev).second)
+    {
+      UintegerValue ttl;
+      l3->GetAttribute ("DefaultTtl", ttl);
+      m_defaultTtl = ttl.Get ();
+      GetObject<Node> ()->RegisterProtocolHandler (MakeCallback (&RoutingProtocol::PromiscuousRx, this),
+                                                   Ipv4L3Protocol::PROT_NUMBER, dev, /*promiscuous=*/ true);
+    }
+
   // Allow neighbor manager use this interface for layer 2 feedback if possible
   Ptr<WifiNetDevice> wifi = dev->GetObject<WifiNetDevice> ();
   if (wifi == 0)
@@ -733,6 +2255,10 @@ RoutingProtocol::NotifyInterfaceUp (uint32_t i)
     }
 
   mac->TraceConnectWithoutContext ("TxErrHeader", m_nb.GetTxErrorCallback ());
+  if (m_enableRouteRefresh || m_enableLinkQuality)
+    {
+      wifi->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferRx", MakeCallback (&RoutingProtocol::MonitorSnifferRx, this));
+    }
 }
 
 void
@@ -751,6 +2277,11 @@ RoutingProtocol::NotifyInterfaceDown (uint32_t i)
         {
           mac->TraceDisconnectWithoutContext ("TxErrHeader",
                                               m_nb.GetTxErrorCallback ());
+          if (m_enableRouteRefresh || m_enableLinkQuality)
+            {
+              wifi->GetPhy ()->TraceDisconnectWithoutContext ("MonitorSnifferRx",
+                                                              MakeCallback (&RoutingProtocol::MonitorSnifferRx, this));
+            }
           m_nb.DelArpCache (l3->GetInterface (i)->GetArpCache ());
         }
     }
@@ -766,6 +2297,7 @@ RoutingProtocol::NotifyInterfaceDown (uint32_t i)
   NS_ASSERT (socket);
   socket->Close ();
   m_socketSubnetBroadcastAddresses.erase (socket);
+  UpdateInterfaceCache ();
 
   if (m_socketAddresses.empty ())
     {
@@ -817,10 +2349,10 @@ RoutingProtocol::NotifyAddAddress (uint32_t i, Ipv4InterfaceAddress address)
           socket->SetAllowBroadcast (true);
           socket->SetIpRecvTtl (true);
           m_socketSubnetBroadcastAddresses.insert (std::make_pair (socket, iface));
+          UpdateInterfaceCache ();
 
           // Add local broadcast record to the routing table
-          Ptr<NetDevice> dev = m_ipv4->GetNetDevice (
-              m_ipv4->GetInterfaceForAddress (iface.GetLocal ()));
+          Ptr<NetDevice> dev = m_ipv4->GetNetDevice (i);
           RoutingTableEntry rt (/*device=*/ dev, /*dst=*/ iface.GetBroadcast (), /*know seqno=*/ true,
                                             /*seqno=*/ 0, /*iface=*/ iface, /*hops=*/ 1,
                                             /*next hop=*/ iface.GetBroadcast (), /*lifetime=*/ Simulator::GetMaximumSimulationTime ());
@@ -848,7 +2380,7 @@ RoutingProtocol::NotifyRemoveAddress (uint32_t i, Ipv4InterfaceAddress address)
       if (unicastSocket)
         {
           unicastSocket->Close ();
-          m_socketAddresses.erase (unicastSocket);
+          m_socketSubnetBroadcastAddresses.erase (unicastSocket);
         }
 
       Ptr<Ipv4L3Protocol> l3 = m_ipv4->GetObject<Ipv4L3Protocol> ();
@@ -879,11 +2411,12 @@ RoutingProtocol::NotifyRemoveAddress (uint32_t i, Ipv4InterfaceAddress address)
           m_socketSubnetBroadcastAddresses.insert (std::make_pair (socket, iface));
 
           // Add local broadcast record to the routing table
-          Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (iface.GetLocal ()));
+          Ptr<NetDevice> dev = m_ipv4->GetNetDevice (i);
           RoutingTableEntry rt (/*device=*/ dev, /*dst=*/ iface.GetBroadcast (), /*know seqno=*/ true, /*seqno=*/ 0, /*iface=*/ iface,
                                             /*hops=*/ 1, /*next hop=*/ iface.GetBroadcast (), /*lifetime=*/ Simulator::GetMaximumSimulationTime ());
           m_routingTable.AddRoute (rt);
         }
+      UpdateInterfaceCache ();
       if (m_socketAddresses.empty ())
         {
           NS_LOG_LOGIC ("No aodv interfaces");
@@ -903,16 +2436,68 @@ bool
 RoutingProtocol::IsMyOwnAddress (Ipv4Address src)
 {
   NS_LOG_FUNCTION (this << src);
+  return m_localAddressInterface.find (src) != m_localAddressInterface.end ();
+}
+
+int32_t
+RoutingProtocol::GetLocalInterface (Ipv4Address local) const
+{
+  std::map<Ipv4Address, uint32_t>::const_iterator i = m_localAddressInterface.find (local);
+  if (i != m_localAddressInterface.end ())
+    {
+      return i->second;
+    }
+  return m_ipv4->GetInterfaceForAddress (local);
+}
+
+void
+RoutingProtocol::UpdateInterfaceCache ()
+{
+  m_interfaceCache.clear ();
+  m_socketInterface.clear ();
+  m_localAddressInterface.clear ();
+  // Drop whatever was still waiting on sockets that have been closed
+  for (std::map<Ptr<Socket>, JitterQueue>::iterator q = m_jitterQueues.begin (); q != m_jitterQueues.end (); )
+    {
+      if (m_socketAddresses.find (q->first) == m_socketAddresses.end ())
+        {
+          q->second.event.Cancel ();
+          m_jitterQueues.erase (q++);
+        }
+      else
+        {
+          ++q;
+        }
+    }
+  if (m_ipv4 == 0)
+    {
+      return;
+    }
+  m_interfaceCache.resize (m_ipv4->GetNInterfaces ());
   for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
          m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
     {
-      Ipv4InterfaceAddress iface = j->second;
-      if (src == iface.GetLocal ())
+      int32_t i = m_ipv4->GetInterfaceForAddress (j->second.GetLocal ());
+      if (i < 0)
         {
-          return true;
+          continue;
         }
+      m_interfaceCache[i].socket = j->first;
+      m_interfaceCache[i].iface = j->second;
+      m_socketInterface[j->first] = i;
+      m_localAddressInterface[j->second.GetLocal ()] = i;
+    }
+  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
+         m_socketSubnetBroadcastAddresses.begin (); j != m_socketSubnetBroadcastAddresses.end (); ++j)
+    {
+      int32_t i = m_ipv4->GetInterfaceForAddress (j->second.GetLocal ());
+      if (i < 0)
+        {
+          continue;
+        }
+      m_interfaceCache[i].broadcastSocket = j->first;
+      m_socketInterface[j->first] = i;
     }
-  return false;
 }
 
 Ptr<Ipv4Route>
@@ -941,16 +2526,11 @@ RoutingProtocol::LoopbackRoute (const Ipv4Header & hdr, Ptr<NetDevice> oif) cons
   std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j = m_socketAddresses.begin ();
   if (oif)
     {
-      // Iterate to find an address on the oif device
-      for (j = m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
+      // Find the address on the oif device
+      int32_t interface = m_ipv4->GetInterfaceForDevice (oif);
+      if (interface >= 0 && interface < (int32_t) m_interfaceCache.size () && m_interfaceCache[interface].socket)
         {
-          Ipv4Address addr = j->second.GetLocal ();
-          int32_t interface = m_ipv4->GetInterfaceForAddress (addr);
-          if (oif == m_ipv4->GetNetDevice (static_cast<uint32_t> (interface)))
-            {
-              rt->SetSource (addr);
-              break;
-            }
+          rt->SetSource (m_interfaceCache[interface].iface.GetLocal ());
         }
     }
   else
@@ -968,16 +2548,44 @@ RoutingProtocol::SendRequest (Ipv4Address dst)
 {
   NS_LOG_FUNCTION ( this << dst);
   // A node SHOULD NOT originate more than RREQ_RATELIMIT RREQ messages per second.
-  if (m_rreqCount == m_rreqRateLimit)
+  // Requests already waiting for the rate limit go first.
+  if (!m_pendingRreq.empty () || !m_rreqRateLimiter.Consume ())
     {
-      Simulator::Schedule (m_rreqRateLimitTimer.GetDelayLeft () + MicroSeconds (100),
-                           &RoutingProtocol::SendRequest, this, dst);
+      if (std::find (m_pendingRreq.begin (), m_pendingRreq.end (), dst) == m_pendingRreq.end ())
+        {
+          m_pendingRreq.push_back (dst);
+        }
+      if (!m_pendingRreqEvent.IsRunning ())
+        {
+          m_pendingRreqEvent = Simulator::Schedule (m_rreqRateLimiter.GetDelay (),
+                                                    &RoutingProtocol::SendPendingRequests, this);
+        }
       return;
     }
-  else
+  OriginateRequest (dst);
+}
+
+void
+RoutingProtocol::SendPendingRequests ()
+{
+  NS_LOG_FUNCTION (this);
+  while (!m_pendingRreq.empty () && m_rreqRateLimiter.Consume ())
+    {
+      Ipv4Address dst = m_pendingRreq.front ();
+      m_pendingRreq.pop_front ();
+      OriginateRequest (dst);
+    }
+  if (!m_pendingRreq.empty ())
     {
-      m_rreqCount++;
+      m_pendingRreqEvent = Simulator::Schedule (m_rreqRateLimiter.GetDelay (),
+                                                &RoutingProtocol::SendPendingRequests, this);
     }
+}
+
+void
+RoutingProtocol::OriginateRequest (Ipv4Address dst)
+{
+  NS_LOG_FUNCTION ( this << dst);
   // Create RREQ header
   RreqHeader rreqHeader;
   rreqHeader.SetDst (dst);
@@ -987,9 +2595,19 @@ RoutingProtocol::SendRequest (Ipv4Address dst)
   uint16_t ttl = m_ttlStart;
   if (m_routingTable.LookupRoute (dst, rt))
     {
+      std::map<Ipv4Address, UnconfirmedRoute>::iterator unconfirmed = m_unconfirmedRoutes.find (dst);
+      if (unconfirmed != m_unconfirmedRoutes.end () && rt.GetValidSeqNo ())
+        {
+          // The entry was confirmed since
+          m_unconfirmedRoutes.erase (unconfirmed);
+          unconfirmed = m_unconfirmedRoutes.end ();
+        }
       if (rt.GetFlag () != IN_SEARCH)
         {
-          ttl = std::min<uint16_t> (rt.GetHop () + m_ttlIncrement, m_netDiameter);
+          if (unconfirmed == m_unconfirmedRoutes.end () || unconfirmed->second.hopsKnown)
+            {
+              ttl = std::min<uint16_t> (rt.GetHop () + m_ttlIncrement, m_netDiameter);
+            }
         }
       else
         {
@@ -1007,6 +2625,10 @@ RoutingProtocol::SendRequest (Ipv4Address dst)
         {
           rreqHeader.SetDstSeqno (rt.GetSeqNo ());
         }
+      else if (unconfirmed != m_unconfirmedRoutes.end () && unconfirmed->second.validSeqNo)
+        {
+          rreqHeader.SetDstSeqno (unconfirmed->second.seqNo);
+        }
       else
         {
           rreqHeader.SetUnknownSeqno (true);
@@ -1018,6 +2640,13 @@ RoutingProtocol::SendRequest (Ipv4Address dst)
     }
   else
     {
+      uint16_t hops;
+      if (LookupHopCount (dst, hops))
+        {
+          // The route was deleted, but where the destination was is still the best guess
+          ttl = std::min<uint16_t> (hops + m_ttlIncrement, m_netDiameter);
+          NS_LOG_LOGIC ("Start expanding ring search for " << dst << " at TTL " << ttl << " from hop count history");
+        }
       rreqHeader.SetUnknownSeqno (true);
       Ptr<NetDevice> dev = 0;
       RoutingTableEntry newEntry (/*device=*/ dev, /*dst=*/ dst, /*validSeqNo=*/ false, /*seqno=*/ 0,
@@ -1032,6 +2661,14 @@ RoutingProtocol::SendRequest (Ipv4Address dst)
       m_routingTable.AddRoute (newEntry);
     }
 
+  BroadcastRequest (rreqHeader, ttl);
+  ScheduleRreqRetry (dst);
+}
+
+void
+RoutingProtocol::BroadcastRequest (RreqHeader & rreqHeader, uint16_t ttl)
+{
+  NS_LOG_FUNCTION (this << rreqHeader.GetDst () << ttl);
   if (m_gratuitousReply)
     {
       rreqHeader.SetGratuitousRrep (true);
@@ -1058,18 +2695,16 @@ RoutingProtocol::SendRequest (Ipv4Address dst)
       rreqHeader.SetOrigin (iface.GetLocal ());
       m_rreqIdCache.IsDuplicate (iface.GetLocal (), m_requestId);
 
-      Ptr<Packet> packet = Create<Packet> ();
-      SocketIpTtlTag tag;
-      tag.SetTtl (ttl);
-      packet->AddPacketTag (tag);
-      packet->AddHeader (rreqHeader);
-      TypeHeader tHeader (AODVTYPE_RREQ);
-      packet->AddHeader (tHeader);
+      Ptr<Packet> packet = CreateControlPacket (rreqHeader, AODVTYPE_RREQ, ttl);
+      if (m_enableLoadBalancing)
+        {
+          AppendLoadExtension (packet, 0);
+        }
 
       // Trace just one packet not all brodcasted packets
       if (traceIt)
         {
-          m_txTrace (packet->Copy ()); // trace
+          m_txTrace (packet); // trace
           traceIt = false;
         }
 
@@ -1085,9 +2720,153 @@ RoutingProtocol::SendRequest (Ipv4Address dst)
         }
       NS_LOG_DEBUG ("Send RREQ with id " << rreqHeader.GetId () << " to socket");
       m_lastBcastTime = Simulator::Now ();
-      Simulator::Schedule (Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10))), &RoutingProtocol::SendTo, this, socket, packet, destination);
+      SendJittered (socket, packet, destination, Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10))));
     }
-  ScheduleRreqRetry (dst);
+}
+
+bool
+RoutingProtocol::StartLocalRepair (Ipv4Address dst)
+{
+  NS_LOG_FUNCTION (this << dst);
+  RoutingTableEntry rt;
+  if (!m_routingTable.LookupValidRoute (dst, rt) || rt.GetHop () > m_maxRepairTtl
+      || m_localRepairs.find (dst) != m_localRepairs.end ())
+    {
+      return false;
+    }
+  // The repair RREQ obeys RREQ_RATELIMIT; without a token the route is reported at once
+  if (!m_pendingRreq.empty () || !m_rreqRateLimiter.Consume ())
+    {
+      NS_LOG_LOGIC ("RreqRateLimit reached, no local repair of the route to " << dst);
+      return false;
+    }
+  NS_LOG_DEBUG ("Local repair of the route to " << dst);
+  uint16_t ttl = std::min<uint16_t> (rt.GetHop () + m_localAddTtl, m_netDiameter);
+  Time timeout = 2 * m_nodeTraversalTime * (ttl + m_timeoutBuffer);
+
+  LocalRepair & repair = m_localRepairs[dst];
+  repair.start = Simulator::Now ();
+  repair.hops = rt.GetHop ();
+  rt.GetPrecursors (repair.precursors);
+  repair.timer = m_timerWheel.Schedule (timeout, MakeCallback (&RoutingProtocol::FinishLocalRepair, this), dst);
+
+  // Packets to dst are buffered while the route is in search
+  rt.SetSeqNo (rt.GetSeqNo () + 1);
+  rt.SetFlag (IN_SEARCH);
+  rt.SetLifeTime (timeout);
+  m_routingTable.Update (rt);
+
+  RreqHeader rreqHeader;
+  rreqHeader.SetDst (dst);
+  rreqHeader.SetDstSeqno (rt.GetSeqNo ());
+  BroadcastRequest (rreqHeader, ttl);
+  return true;
+}
+
+void
+RoutingProtocol::FinishLocalRepair (Ipv4Address dst)
+{
+  NS_LOG_FUNCTION (this << dst);
+  std::map<Ipv4Address, LocalRepair>::iterator i = m_localRepairs.find (dst);
+  if (i == m_localRepairs.end ())
+    {
+      return;
+    }
+  LocalRepair repair = i->second;
+  m_localRepairs.erase (i);
+  m_timerWheel.Cancel (repair.timer);
+
+  RoutingTableEntry * rt = m_routingTable.Find (dst);
+  bool success = (rt != 0 && rt->GetFlag () == VALID);
+  NS_LOG_DEBUG ("Local repair of the route to " << dst << (success ? " succeeded" : " failed"));
+  m_localRepairTrace (dst, success, Simulator::Now () - repair.start);
+  if (rt == 0)
+    {
+      m_queue.DropPacketWithDst (dst);
+      return;
+    }
+  // The new route is set from the RREP, which knows nothing of the nodes upstream
+  for (std::vector<Ipv4Address>::const_iterator j = repair.precursors.begin (); j != repair.precursors.end (); ++j)
+    {
+      rt->InsertPrecursor (*j);
+    }
+  RerrHeader rerrHeader;
+  if (success)
+    {
+      if (rt->GetHop () <= repair.hops)
+        {
+          return;
+        }
+      // The route got longer: let the sources know, without breaking it, so they may look for a better one
+      rerrHeader.SetNoDelete (true);
+    }
+  else
+    {
+      m_queue.DropPacketWithDst (dst);
+      rt->Invalidate (m_routingTable.GetBadLinkLifetime ());
+    }
+  rerrHeader.AddUnDestination (dst, rt->GetSeqNo ());
+  PrecursorSet precursors;
+  AddPrecursors (*rt, precursors);
+  SendRerrMessage (CreateControlPacket (rerrHeader, AODVTYPE_RERR, 1), precursors);
+}
+
+void
+RoutingProtocol::OfferAlternatePath (Ipv4Address dst, Ipv4Address nextHop, Ipv4Address receiver,
+                                     uint16_t hops, uint32_t seqNo, Time lifetime)
+{
+  NS_LOG_FUNCTION (this << dst << nextHop << hops << seqNo);
+  RoutingTableEntry const * rt = m_routingTable.Find (dst);
+  // A path no longer than the route, towards the same sequence number, cannot lead back through this node
+  if (rt == 0 || rt->GetFlag () != VALID || !rt->GetValidSeqNo () || rt->GetSeqNo () != seqNo
+      || rt->GetNextHop () == nextHop || hops > rt->GetHop () || IsMyOwnAddress (dst) || IsWeakLink (nextHop))
+    {
+      return;
+    }
+  AlternatePathCache::Path path;
+  path.nextHop = nextHop;
+  path.device = m_ipv4->GetNetDevice (GetLocalInterface (receiver));
+  path.iface = m_ipv4->GetAddress (GetLocalInterface (receiver), 0);
+  path.hops = hops;
+  path.seqNo = seqNo;
+  path.expire = Simulator::Now () + lifetime;
+  NS_LOG_LOGIC ("Alternate path to " << dst << " through " << nextHop << " with " << hops << " hops");
+  m_alternatePaths.Add (dst, path, m_maxPaths);
+}
+
+bool
+RoutingProtocol::SwitchToAlternatePath (Ipv4Address dst)
+{
+  NS_LOG_FUNCTION (this << dst);
+  if (!m_enableMultipath)
+    {
+      return false;
+    }
+  RoutingTableEntry const * rt = m_routingTable.Find (dst);
+  if (rt == 0)
+    {
+      return false;
+    }
+  AlternatePathCache::Path path;
+  while (m_alternatePaths.Pop (dst, rt->GetSeqNo (), path))
+    {
+      RoutingTableEntry const * toNextHop = m_routingTable.Find (path.nextHop);
+      if (toNextHop == 0 || toNextHop->GetFlag () != VALID || toNextHop->GetHop () != 1)
+        {
+          continue;
+        }
+      NS_LOG_DEBUG ("Route to " << dst << " switched to next hop " << path.nextHop);
+      RoutingTableEntry entry = *rt;
+      entry.SetNextHop (path.nextHop);
+      entry.SetOutputDevice (path.device);
+      entry.SetInterface (path.iface);
+      entry.SetHop (path.hops);
+      entry.SetFlag (VALID);
+      entry.SetLifeTime (path.expire - Simulator::Now ());
+      m_routingTable.Update (entry);
+      return true;
+    }
+  return false;
 }
 
 void
@@ -1096,18 +2875,143 @@ RoutingProtocol::SendTo (Ptr<Socket> socket, Ptr<Packet> packet, Ipv4Address des
   socket->SendTo (packet, 0, InetSocketAddress (destination, AODV_PORT));
   //m_txTrace (packet->Copy ()); // trace
 }
+
+Ptr<Packet>
+RoutingProtocol::CreateControlPacket (Header const & header, MessageType type, uint8_t ttl) const
+{
+  // The buffer grows to the largest header seen so far and its storage is
+  // recycled by Buffer's free list, so a fresh packet per message costs no
+  // more than a pooled one would; what matters is serializing it only once.
+  Ptr<Packet> packet = Create<Packet> ();
+  SocketIpTtlTag tag;
+  tag.SetTtl (ttl);
+  packet->AddPacketTag (tag);
+  packet->AddHeader (header);
+  packet->AddHeader (TypeHeader (type));
+  return packet;
+}
+
+uint64_t
+RoutingProtocol::SendJittered (Ptr<Socket> socket, Ptr<Packet> packet, Ipv4Address destination, Time jitter)
+{
+  NS_LOG_FUNCTION (this << socket << packet->GetUid () << destination << jitter);
+  JitterQueue & queue = m_jitterQueues[socket];
+  JitterEntry entry;
+  entry.packet = packet;
+  entry.destination = destination;
+  entry.id = m_jitterId++;
+  // Packets released at the same time keep their queueing order
+  std::multimap<Time, JitterEntry>::iterator i =
+    queue.pending.insert (std::make_pair (Simulator::Now () + jitter, entry));
+  if (i == queue.pending.begin ())
+    {
+      queue.event.Cancel ();
+      queue.event = Simulator::Schedule (jitter, &RoutingProtocol::JitterQueueExpire, this, socket);
+    }
+  return entry.id;
+}
+
+bool
+RoutingProtocol::CancelJittered (Ptr<Socket> socket, uint64_t id)
+{
+  NS_LOG_FUNCTION (this << socket << id);
+  std::map<Ptr<Socket>, JitterQueue>::iterator q = m_jitterQueues.find (socket);
+  if (q == m_jitterQueues.end ())
+    {
+      return false;
+    }
+  std::multimap<Time, JitterEntry> & pending = q->second.pending;
+  for (std::multimap<Time, JitterEntry>::iterator i = pending.begin (); i != pending.end (); ++i)
+    {
+      if (i->second.id != id)
+        {
+          continue;
+        }
+      bool first = (i == pending.begin ());
+      pending.erase (i);
+      if (first)
+        {
+          q->second.event.Cancel ();
+          if (!pending.empty ())
+            {
+              q->second.event = Simulator::Schedule (pending.begin ()->first - Simulator::Now (),
+                                                     &RoutingProtocol::JitterQueueExpire, this, socket);
+            }
+        }
+      return true;
+    }
+  return false;
+}
+
 void
-RoutingProtocol::ScheduleRreqRetry (Ipv4Address dst)
+RoutingProtocol::JitterQueueExpire (Ptr<Socket> socket)
 {
-  NS_LOG_FUNCTION (this << dst);
-  if (m_addressReqTimer.find (dst) == m_addressReqTimer.end ())
+  NS_LOG_FUNCTION (this << socket);
+  std::map<Ptr<Socket>, JitterQueue>::iterator q = m_jitterQueues.find (socket);
+  if (q == m_jitterQueues.end ())
+    {
+      return;
+    }
+  std::multimap<Time, JitterEntry> & pending = q->second.pending;
+  while (!pending.empty () && pending.begin ()->first <= Simulator::Now ())
+    {
+      JitterEntry entry = pending.begin ()->second;
+      pending.erase (pending.begin ());
+      if (m_enableAggregation)
+        {
+          AggregateQueued (pending, entry);
+        }
+      SendTo (socket, entry.packet, entry.destination);
+    }
+  if (!pending.empty ())
+    {
+      q->second.event = Simulator::Schedule (pending.begin ()->first - Simulator::Now (),
+                                             &RoutingProtocol::JitterQueueExpire, this, socket);
+    }
+}
+
+void
+RoutingProtocol::AggregateQueued (std::multimap<Time, JitterEntry> & pending, JitterEntry & entry)
+{
+  NS_LOG_FUNCTION (this << entry.packet->GetUid ());
+  // The IP TTL applies to the whole datagram, so only messages sent with the
+  // same TTL can share one; the packet may be traced or shared, hence the copy
+  SocketIpTtlTag ttl;
+  entry.packet->PeekPacketTag (ttl);
+  Ptr<Packet> aggregate = 0;
+  // Packets due later keep their jitter, and may still be cancelled
+  for (std::multimap<Time, JitterEntry>::iterator i = pending.begin ();
+       i != pending.end () && i->first <= Simulator::Now (); )
+    {
+      SocketIpTtlTag other;
+      i->second.packet->PeekPacketTag (other);
+      uint32_t size = (aggregate ? aggregate : entry.packet)->GetSize ();
+      if (i->second.destination != entry.destination || other.GetTtl () != ttl.GetTtl ()
+          || size + i->second.packet->GetSize () > m_maxAggregateSize)
+        {
+          ++i;
+          continue;
+        }
+      if (!aggregate)
+        {
+          aggregate = entry.packet->Copy ();
+        }
+      NS_LOG_LOGIC ("Aggregate packet " << i->second.packet->GetUid () << " into " << entry.packet->GetUid ());
+      aggregate->AddAtEnd (i->second.packet);
+      pending.erase (i++);
+    }
+  if (aggregate)
     {
-      Timer timer (Timer::CANCEL_ON_DESTROY);
-      m_addressReqTimer[dst] = timer;
+      entry.packet = aggregate;
     }
-  m_addressReqTimer[dst].SetFunction (&RoutingProtocol::RouteRequestTimerExpire, this);
-  m_addressReqTimer[dst].Remove ();
-  m_addressReqTimer[dst].SetArguments (dst);
+}
+
+void
+RoutingProtocol::ScheduleRreqRetry (Ipv4Address dst)
+{
+  NS_LOG_FUNCTION (this << dst);
+  TimerWheel::TimerId & timer = m_addressReqTimer[dst];
+  m_timerWheel.Cancel (timer);
   RoutingTableEntry rt;
   m_routingTable.LookupRoute (dst, rt);
   Time retry;
@@ -1120,7 +3024,7 @@ RoutingProtocol::ScheduleRreqRetry (Ipv4Address dst)
       // Binary exponential backoff
       retry = std::pow<uint16_t> (2, rt.GetRreqCnt () - 1) * m_netTraversalTime;
     }
-  m_addressReqTimer[dst].Schedule (retry);
+  timer = m_timerWheel.Schedule (retry, MakeCallback (&RoutingProtocol::RouteRequestTimerExpire, this), dst);
   NS_LOG_LOGIC ("Scheduled RREQ retry in " << retry.GetSeconds () << " seconds");
 }
 
@@ -1134,13 +3038,10 @@ RoutingProtocol::RecvAodv (Ptr<Socket> socket)
   Ipv4Address sender = inetSourceAddr.GetIpv4 ();
   Ipv4Address receiver;
 
-  if (m_socketAddresses.find (socket) != m_socketAddresses.end ())
-    {
-      receiver = m_socketAddresses[socket].GetLocal ();
-    }
-  else if (m_socketSubnetBroadcastAddresses.find (socket) != m_socketSubnetBroadcastAddresses.end ())
+  std::map<Ptr<Socket>, uint32_t>::const_iterator i = m_socketInterface.find (socket);
+  if (i != m_socketInterface.end ())
     {
-      receiver = m_socketSubnetBroadcastAddresses[socket].GetLocal ();
+      receiver = m_interfaceCache[i->second].iface.GetLocal ();
     }
   else
     {
@@ -1151,53 +3052,124 @@ RoutingProtocol::RecvAodv (Ptr<Socket> socket)
   m_rxTrace (packet->Copy ()); // trace
 
   UpdateRouteToNeighbor (sender, receiver);
-  TypeHeader tHeader (AODVTYPE_RREQ);
+  while (packet->GetSize () > 0)
+    {
+      TypeHeader tHeader (AODVTYPE_RREQ);
+      Ptr<Packet> message = RemoveMessage (packet, tHeader);
+      if (!message)
+        {
+          NS_LOG_DEBUG ("AODV message " << packet->GetUid () << " with unknown type received: " << tHeader.Get () << ". Drop");
+          return; // drop
+        }
+      switch (tHeader.Get ())
+        {
+        case AODVTYPE_RREQ:
+          {
+            if (IsWeakLink (sender))
+              {
+                // Only the first copy of a RREQ is processed: let copies over strong links come first
+                NS_LOG_LOGIC ("Delay RREQ received over weak link from " << sender);
+                while (!m_weakRreqEvents.empty () && m_weakRreqEvents.front ().IsExpired ())
+                  {
+                    m_weakRreqEvents.pop_front ();
+                  }
+                m_weakRreqEvents.push_back (Simulator::Schedule (m_weakLinkRreqDelay, &RoutingProtocol::RecvRequest,
+                                                                 this, message, receiver, sender));
+                break;
+              }
+            RecvRequest (message, receiver, sender);
+            break;
+          }
+        case AODVTYPE_RREP:
+          {
+            RecvReply (message, receiver, sender);
+            break;
+          }
+        case AODVTYPE_RERR:
+          {
+            RecvError (message, sender);
+            break;
+          }
+        case AODVTYPE_RREP_ACK:
+          {
+            RecvReplyAck (sender);
+            break;
+          }
+        }
+    }
+}
+
+Ptr<Packet>
+RoutingProtocol::RemoveMessage (Ptr<Packet> packet, TypeHeader & tHeader)
+{
   packet->RemoveHeader (tHeader);
   if (!tHeader.IsValid ())
     {
-      NS_LOG_DEBUG ("AODV message " << packet->GetUid () << " with unknown type received: " << tHeader.Get () << ". Drop");
-      return; // drop
+      return 0;
     }
+  uint32_t size = 0;
   switch (tHeader.Get ())
     {
     case AODVTYPE_RREQ:
       {
-        RecvRequest (packet, receiver, sender);
+        RreqHeader rreqHeader;
+        size = packet->PeekHeader (rreqHeader);
         break;
       }
     case AODVTYPE_RREP:
       {
-        RecvReply (packet, receiver, sender);
+        RrepHeader rrepHeader;
+        size = packet->PeekHeader (rrepHeader);
         break;
       }
     case AODVTYPE_RERR:
       {
-        RecvError (packet, sender);
+        RerrHeader rerrHeader;
+        size = packet->PeekHeader (rerrHeader);
         break;
       }
     case AODVTYPE_RREP_ACK:
       {
-        RecvReplyAck (sender);
+        RrepAckHeader rrepAckHeader;
+        size = packet->PeekHeader (rrepAckHeader);
         break;
       }
     }
+  if ((tHeader.Get () == AODVTYPE_RREQ || tHeader.Get () == AODVTYPE_RREP)
+      && packet->GetSize () >= size + LoadExtensionHeader ().GetSerializedSize ())
+    {
+      // A load extension appended to the message belongs to it
+      Ptr<Packet> rest = packet->CreateFragment (size, packet->GetSize () - size);
+      LoadExtensionHeader load;
+      rest->PeekHeader (load);
+      if (load.IsValid ())
+        {
+          size += load.GetSerializedSize ();
+        }
+    }
+  if (size >= packet->GetSize ())
+    {
+      // The common case of one message per datagram needs no fragment
+      Ptr<Packet> message = packet->Copy ();
+      packet->RemoveAtStart (packet->GetSize ());
+      return message;
+    }
+  Ptr<Packet> message = packet->CreateFragment (0, size);
+  packet->RemoveAtStart (size);
+  return message;
 }
 
 bool
 RoutingProtocol::UpdateRouteLifeTime (Ipv4Address addr, Time lifetime)
 {
   NS_LOG_FUNCTION (this << addr << lifetime);
-  RoutingTableEntry rt;
-  if (m_routingTable.LookupRoute (addr, rt))
+  RoutingTableEntry * rt = m_routingTable.Find (addr);
+  if (rt != 0 && rt->GetFlag () == VALID)
     {
-      if (rt.GetFlag () == VALID)
-        {
-          NS_LOG_DEBUG ("Updating VALID route");
-          rt.SetRreqCnt (0);
-          rt.SetLifeTime (std::max (lifetime, rt.GetLifeTime ()));
-          m_routingTable.Update (rt);
-          return true;
-        }
+      NS_LOG_DEBUG ("Updating VALID route");
+      rt->SetRreqCnt (0);
+      rt->SetLifeTime (std::max (lifetime, rt->GetLifeTime ()));
+      return true;
     }
   return false;
 }
@@ -1206,27 +3178,27 @@ void
 RoutingProtocol::UpdateRouteToNeighbor (Ipv4Address sender, Ipv4Address receiver)
 {
   NS_LOG_FUNCTION (this << "sender " << sender << " receiver " << receiver);
-  RoutingTableEntry toNeighbor;
-  if (!m_routingTable.LookupRoute (sender, toNeighbor))
+  RoutingTableEntry * toNeighbor = m_routingTable.Find (sender);
+  if (toNeighbor == 0)
     {
-      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver));
+      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (GetLocalInterface (receiver));
       RoutingTableEntry newEntry (/*device=*/ dev, /*dst=*/ sender, /*know seqno=*/ false, /*seqno=*/ 0,
-                                              /*iface=*/ m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0),
+                                              /*iface=*/ m_ipv4->GetAddress (GetLocalInterface (receiver), 0),
                                               /*hops=*/ 1, /*next hop=*/ sender, /*lifetime=*/ m_activeRouteTimeout);
       m_routingTable.AddRoute (newEntry);
     }
   else
     {
-      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver));
-      if (toNeighbor.GetValidSeqNo () && (toNeighbor.GetHop () == 1) && (toNeighbor.GetOutputDevice () == dev))
+      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (GetLocalInterface (receiver));
+      if (toNeighbor->GetValidSeqNo () && (toNeighbor->GetHop () == 1) && (toNeighbor->GetOutputDevice () == dev))
         {
-          toNeighbor.SetLifeTime (std::max (m_activeRouteTimeout, toNeighbor.GetLifeTime ()));
+          toNeighbor->SetLifeTime (std::max (m_activeRouteTimeout, toNeighbor->GetLifeTime ()));
         }
       else
         {
           RoutingTableEntry newEntry (/*device=*/ dev, /*dst=*/ sender, /*know seqno=*/ false, /*seqno=*/ 0,
-                                                  /*iface=*/ m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0),
-                                                  /*hops=*/ 1, /*next hop=*/ sender, /*lifetime=*/ std::max (m_activeRouteTimeout, toNeighbor.GetLifeTime ()));
+                                                  /*iface=*/ m_ipv4->GetAddress (GetLocalInterface (receiver), 0),
+                                                  /*hops=*/ 1, /*next hop=*/ sender, /*lifetime=*/ std::max (m_activeRouteTimeout, toNeighbor->GetLifeTime ()));
           m_routingTable.Update (newEntry);
         }
     }
@@ -1239,6 +3211,8 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
   NS_LOG_FUNCTION (this);
   RreqHeader rreqHeader;
   p->RemoveHeader (rreqHeader);
+  uint32_t load = 0;
+  bool hasLoad = m_enableLoadBalancing && RemoveLoadExtension (p, load);
 
   // A node ignores all RREQs received from any node in its blacklist
   RoutingTableEntry toPrev;
@@ -1261,6 +3235,24 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
   if (m_rreqIdCache.IsDuplicate (origin, id))
     {
       NS_LOG_DEBUG ("Ignoring RREQ due to duplicate");
+      if (m_enableChannelStriping)
+        {
+          CancelStripedRreq (origin, id, receiver);
+        }
+      if (m_rreqCounterThreshold > 0)
+        {
+          CountRreqDuplicate (origin, id);
+        }
+      if (m_enableMultipath)
+        {
+          uint8_t hop = rreqHeader.GetHopCount () + 1;
+          OfferAlternatePath (origin, src, receiver, hop, rreqHeader.GetOriginSeqno (),
+                              Time (2 * m_netTraversalTime - 2 * hop * m_nodeTraversalTime));
+        }
+      if (hasLoad && IsMyOwnAddress (rreqHeader.GetDst ()))
+        {
+          AnswerLighterRequest (rreqHeader, load, receiver, src);
+        }
       return;
     }
 
@@ -1281,9 +3273,9 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
   RoutingTableEntry toOrigin;
   if (!m_routingTable.LookupRoute (origin, toOrigin))
     {
-      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver));
+      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (GetLocalInterface (receiver));
       RoutingTableEntry newEntry (/*device=*/ dev, /*dst=*/ origin, /*validSeno=*/ true, /*seqNo=*/ rreqHeader.GetOriginSeqno (),
-                                              /*iface=*/ m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0), /*hops=*/ hop,
+                                              /*iface=*/ m_ipv4->GetAddress (GetLocalInterface (receiver), 0), /*hops=*/ hop,
                                               /*nextHop*/ src, /*timeLife=*/ Time ((2 * m_netTraversalTime - 2 * hop * m_nodeTraversalTime)));
       m_routingTable.AddRoute (newEntry);
     }
@@ -1302,23 +3294,24 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
         }
       toOrigin.SetValidSeqNo (true);
       toOrigin.SetNextHop (src);
-      toOrigin.SetOutputDevice (m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver)));
-      toOrigin.SetInterface (m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0));
+      toOrigin.SetOutputDevice (m_ipv4->GetNetDevice (GetLocalInterface (receiver)));
+      toOrigin.SetInterface (m_ipv4->GetAddress (GetLocalInterface (receiver), 0));
       toOrigin.SetHop (hop);
       toOrigin.SetLifeTime (std::max (Time (2 * m_netTraversalTime - 2 * hop * m_nodeTraversalTime),
                                       toOrigin.GetLifeTime ()));
       m_routingTable.Update (toOrigin);
       //m_nb.Update (src, Time (AllowedHelloLoss * HelloInterval));
     }
+  RecordHopCount (origin, hop);
 
 
   RoutingTableEntry toNeighbor;
   if (!m_routingTable.LookupRoute (src, toNeighbor))
     {
       NS_LOG_DEBUG ("Neighbor:" << src << " not found in routing table. Creating an entry");
-      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver));
+      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (GetLocalInterface (receiver));
       RoutingTableEntry newEntry (dev, src, false, rreqHeader.GetOriginSeqno (),
-                                  m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0),
+                                  m_ipv4->GetAddress (GetLocalInterface (receiver), 0),
                                   1, src, m_activeRouteTimeout);
       m_routingTable.AddRoute (newEntry);
     }
@@ -1328,13 +3321,14 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
       toNeighbor.SetValidSeqNo (false);
       toNeighbor.SetSeqNo (rreqHeader.GetOriginSeqno ());
       toNeighbor.SetFlag (VALID);
-      toNeighbor.SetOutputDevice (m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver)));
-      toNeighbor.SetInterface (m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0));
+      toNeighbor.SetOutputDevice (m_ipv4->GetNetDevice (GetLocalInterface (receiver)));
+      toNeighbor.SetInterface (m_ipv4->GetAddress (GetLocalInterface (receiver), 0));
       toNeighbor.SetHop (1);
       toNeighbor.SetNextHop (src);
       m_routingTable.Update (toNeighbor);
     }
-  m_nb.Update (src, Time (m_allowedHelloLoss * m_helloInterval));
+  // The neighbor may be an adaptive one that sends its next hello only after the longest interval
+  m_nb.Update (src, Time (m_allowedHelloLoss * (m_enableAdaptiveHello ? m_maxHelloInterval : m_helloInterval)));
 
   NS_LOG_LOGIC (receiver << " receive RREQ with hop count " << static_cast<uint32_t> (rreqHeader.GetHopCount ())
                          << " ID " << rreqHeader.GetId ()
@@ -1346,6 +3340,15 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
     {
       m_routingTable.LookupRoute (origin, toOrigin);
       NS_LOG_DEBUG ("Send reply since I am the destination");
+      if (hasLoad)
+        {
+          // Later copies of this RREQ may come over lighter paths
+          PurgeRreqAnswers ();
+          RreqAnswer & answer = m_rreqAnswers[std::make_pair (origin, id)];
+          answer.hops = hop;
+          answer.load = load;
+          m_rreqAnswerTimes.push_back (std::make_pair (Simulator::Now () + m_pathDiscoveryTime, std::make_pair (origin, id)));
+        }
       SendReply (rreqHeader, toOrigin);
       return;
     }
@@ -1385,33 +3388,60 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
         }
     }
 
-  SocketIpTtlTag tag;
-  p->RemovePacketTag (tag);
-  if (tag.GetTtl () < 2)
+  SocketIpTtlTag tag;
+  p->RemovePacketTag (tag);
+  if (tag.GetTtl () < 2)
+    {
+      NS_LOG_DEBUG ("TTL exceeded. Drop RREQ origin " << src << " destination " << dst );
+      return;
+    }
+
+  // Gossip: rebroadcast with a given probability only
+  if (m_gossipProbability < 1.0 && m_uniformRandomVariable->GetValue (0, 1) >= m_gossipProbability)
+    {
+      NS_LOG_DEBUG ("Gossip: no rebroadcast of RREQ origin " << origin << " id " << id);
+      return;
+    }
+
+  // Forward the received packet itself: the headers removed above left their
+  // bytes reserved at the front of the buffer, so adding them back only
+  // rewrites the hop count and sequence fields in place, and each interface
+  // gets a copy-on-write reference to the same buffer.
+  p->RemoveAllPacketTags ();
+  SocketIpTtlTag ttl;
+  ttl.SetTtl (tag.GetTtl () - 1);
+  p->AddPacketTag (ttl);
+  if (hasLoad)
     {
-      NS_LOG_DEBUG ("TTL exceeded. Drop RREQ origin " << src << " destination " << dst );
-      return;
+      p->AddHeader (LoadExtensionHeader (load + GetLoad ()));
     }
+  p->AddHeader (rreqHeader);
+  TypeHeader tHeader (AODVTYPE_RREQ);
+  p->AddHeader (tHeader);
 
   bool traceIt = true; // trace
 
+  // Remember the queued copies while duplicates of this RREQ may cancel them
+  RreqForward * forward = 0;
+  Time lastRelease = Simulator::Now ();
+  bool striping = m_enableChannelStriping && m_socketAddresses.size () > 1;
+  if (m_rreqCounterThreshold > 0 || striping)
+    {
+      PurgeRreqForwards ();
+      forward = &m_rreqForwards[std::make_pair (origin, id)];
+    }
+
   for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
          m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
     {
       Ptr<Socket> socket = j->first;
       Ipv4InterfaceAddress iface = j->second;
-      Ptr<Packet> packet = Create<Packet> ();
-      SocketIpTtlTag ttl;
-      ttl.SetTtl (tag.GetTtl () - 1);
-      packet->AddPacketTag (ttl);
-      packet->AddHeader (rreqHeader);
-      TypeHeader tHeader (AODVTYPE_RREQ);
-      packet->AddHeader (tHeader);
+      Ptr<Packet> packet = p->Copy ();
 
       // Trace just one packet not all brodcasted packets
       if (traceIt)
         {
-          m_txTrace (packet->Copy ()); // trace
+          m_txTrace (packet); // trace
           traceIt = false;
         }
 
@@ -1426,9 +3456,290 @@ RoutingProtocol::RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address s
           destination = iface.GetBroadcast ();
         }
       m_lastBcastTime = Simulator::Now ();
-      Simulator::Schedule (Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10))), &RoutingProtocol::SendTo, this, socket, packet, destination);
+      Time jitter = Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10)));
+      if (striping && iface.GetLocal () == receiver)
+        {
+          // Neighbors on the other channels take the RREQ further first
+          jitter += m_channelStripingDelay;
+          forward->delayed = receiver;
+        }
+      uint64_t sendId = SendJittered (socket, packet, destination, jitter);
+      if (forward)
+        {
+          forward->sends.push_back (std::make_pair (socket, sendId));
+          lastRelease = std::max (lastRelease, Simulator::Now () + jitter);
+        }
+    }
+  if (forward)
+    {
+      m_rreqForwardTimes.push_back (std::make_pair (lastRelease, std::make_pair (origin, id)));
+    }
+}
+
+void
+RoutingProtocol::CountRreqDuplicate (Ipv4Address origin, uint32_t id)
+{
+  PurgeRreqForwards ();
+  std::map<std::pair<Ipv4Address, uint32_t>, RreqForward>::iterator i =
+    m_rreqForwards.find (std::make_pair (origin, id));
+  if (i == m_rreqForwards.end ())
+    {
+      return;
+    }
+  if (++i->second.duplicates < m_rreqCounterThreshold)
+    {
+      return;
+    }
+  NS_LOG_DEBUG ("Heard " << i->second.duplicates << " copies of RREQ origin " << origin << " id " << id
+                         << ", cancel its rebroadcast");
+  for (std::vector<std::pair<Ptr<Socket>, uint64_t> >::const_iterator j = i->second.sends.begin ();
+       j != i->second.sends.end (); ++j)
+    {
+      CancelJittered (j->first, j->second);
+    }
+  m_rreqForwards.erase (i);
+}
+
+void
+RoutingProtocol::CancelStripedRreq (Ipv4Address origin, uint32_t id, Ipv4Address receiver)
+{
+  PurgeRreqForwards ();
+  std::map<std::pair<Ipv4Address, uint32_t>, RreqForward>::iterator i =
+    m_rreqForwards.find (std::make_pair (origin, id));
+  if (i == m_rreqForwards.end () || i->second.delayed != receiver)
+    {
+      return;
+    }
+  std::vector<std::pair<Ptr<Socket>, uint64_t> > & sends = i->second.sends;
+  for (std::vector<std::pair<Ptr<Socket>, uint64_t> >::iterator j = sends.begin (); j != sends.end (); ++j)
+    {
+      std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator k = m_socketAddresses.find (j->first);
+      if (k != m_socketAddresses.end () && k->second.GetLocal () == receiver)
+        {
+          NS_LOG_DEBUG ("RREQ origin " << origin << " id " << id << " already carried on " << receiver
+                                       << ", cancel its rebroadcast there");
+          CancelJittered (j->first, j->second);
+          sends.erase (j);
+          break;
+        }
+    }
+  i->second.delayed = Ipv4Address ();
+}
+
+void
+RoutingProtocol::PurgeRreqForwards ()
+{
+  while (!m_rreqForwardTimes.empty () && m_rreqForwardTimes.front ().first < Simulator::Now ())
+    {
+      m_rreqForwards.erase (m_rreqForwardTimes.front ().second);
+      m_rreqForwardTimes.pop_front ();
+    }
+}
+
+void
+RoutingProtocol::AnswerLighterRequest (RreqHeader const & rreqHeader, uint32_t load, Ipv4Address receiver, Ipv4Address src)
+{
+  NS_LOG_FUNCTION (this << rreqHeader.GetOrigin () << rreqHeader.GetId () << load);
+  PurgeRreqAnswers ();
+  std::map<std::pair<Ipv4Address, uint32_t>, RreqAnswer>::iterator i =
+    m_rreqAnswers.find (std::make_pair (rreqHeader.GetOrigin (), rreqHeader.GetId ()));
+  if (i == m_rreqAnswers.end ())
+    {
+      return;
+    }
+  uint8_t hop = rreqHeader.GetHopCount () + 1;
+  RoutingTableEntry toOrigin;
+  if (hop > i->second.hops + m_loadHopSlack || load >= i->second.load
+      || !m_routingTable.LookupRoute (rreqHeader.GetOrigin (), toOrigin))
+    {
+      return;
+    }
+  NS_LOG_DEBUG ("Answer RREQ origin " << rreqHeader.GetOrigin () << " id " << rreqHeader.GetId ()
+                                      << " again through " << src << " with load " << load);
+  i->second.hops = std::min<uint16_t> (i->second.hops, hop);
+  i->second.load = load;
+  // The RREP travels back along the reverse route, which must follow the lighter copy
+  toOrigin.SetNextHop (src);
+  toOrigin.SetOutputDevice (m_ipv4->GetNetDevice (GetLocalInterface (receiver)));
+  toOrigin.SetInterface (m_ipv4->GetAddress (GetLocalInterface (receiver), 0));
+  toOrigin.SetHop (hop);
+  toOrigin.SetFlag (VALID);
+  toOrigin.SetLifeTime (std::max (Time (2 * m_netTraversalTime - 2 * hop * m_nodeTraversalTime),
+                                  toOrigin.GetLifeTime ()));
+  m_routingTable.Update (toOrigin);
+  SendReply (rreqHeader, toOrigin);
+}
+
+void
+RoutingProtocol::PurgeRreqAnswers ()
+{
+  while (!m_rreqAnswerTimes.empty () && m_rreqAnswerTimes.front ().first < Simulator::Now ())
+    {
+      m_rreqAnswers.erase (m_rreqAnswerTimes.front ().second);
+      m_rreqAnswerTimes.pop_front ();
+    }
+}
+
+bool
+RoutingProtocol::IsLighterPath (Ipv4Address dst, Ipv4Address nextHop, uint32_t load) const
+{
+  std::map<Ipv4Address, std::pair<Ipv4Address, uint32_t> >::const_iterator i = m_routeLoad.find (dst);
+  return i != m_routeLoad.end () && i->second.first == nextHop && load < i->second.second;
+}
+
+void
+RoutingProtocol::UpdateForwardRate ()
+{
+  Time now = Simulator::Now ();
+  if (now - m_forwardWindowStart > Seconds (32))
+    {
+      // Idle long enough for the average to have decayed
+      m_forwardRate = 0;
+      m_forwardCount = 0;
+      m_forwardWindowStart = now;
+      return;
+    }
+  while (m_forwardWindowStart + Seconds (1) <= now)
+    {
+      m_forwardRate = 0.75 * m_forwardRate + 0.25 * m_forwardCount;
+      m_forwardCount = 0;
+      m_forwardWindowStart += Seconds (1);
+    }
+}
+
+void
+RoutingProtocol::NoteActiveFlow (Ipv4Address dst)
+{
+  std::map<Ipv4Address, ActiveFlow>::iterator i = m_activeFlows.find (dst);
+  if (i != m_activeFlows.end ())
+    {
+      i->second.lastUse = Simulator::Now ();
+      return;
+    }
+  NS_LOG_LOGIC ("Flow to " << dst << " active");
+  ActiveFlow & flow = m_activeFlows[dst];
+  flow.lastUse = Simulator::Now ();
+  flow.lastAttempt = Simulator::Now () - m_pathDiscoveryTime;
+  flow.attempts = 0;
+  m_timerWheel.Schedule (m_routeRefreshLead / 2, MakeCallback (&RoutingProtocol::CheckActiveFlow, this), dst);
+}
+
+void
+RoutingProtocol::CheckActiveFlow (Ipv4Address dst)
+{
+  NS_LOG_FUNCTION (this << dst);
+  std::map<Ipv4Address, ActiveFlow>::iterator i = m_activeFlows.find (dst);
+  if (i == m_activeFlows.end ())
+    {
+      return;
+    }
+  ActiveFlow & flow = i->second;
+  RoutingTableEntry const * rt = m_routingTable.Find (dst);
+  if (rt == 0 || rt->GetFlag () != VALID || Simulator::Now () - flow.lastUse > m_activeRouteTimeout)
+    {
+      // The flow stopped, or its route is rediscovered on demand
+      NS_LOG_LOGIC ("Flow to " << dst << " no longer active");
+      m_activeFlows.erase (i);
+      return;
+    }
+  // Traffic keeps the route lifetime ahead, so the route is at risk only once
+  // the flow pauses or the link to the next hop is about to be closed
+  Ipv4Address nextHop = rt->GetNextHop ();
+  bool expiring = (rt->GetLifeTime () <= m_routeRefreshLead)
+    || (m_nb.IsNeighbor (nextHop) && m_nb.GetExpireTime (nextHop) <= m_routeRefreshLead);
+  if ((expiring || IsSignalFading (nextHop))
+      && flow.attempts < m_rreqRetries
+      && Simulator::Now () - flow.lastAttempt >= m_pathDiscoveryTime
+      && m_addressReqTimer.find (dst) == m_addressReqTimer.end ()
+      && m_pendingRreq.empty () && m_rreqRateLimiter.Consume ())
+    {
+      // The route stays valid meanwhile; asking for a newer sequence number than
+      // the one known makes the destination answer, and the answer replaces the route
+      NS_LOG_DEBUG ("Background discovery of the route to " << dst << (expiring ? " expiring" : " fading"));
+      flow.lastAttempt = Simulator::Now ();
+      ++flow.attempts;
+      RreqHeader rreqHeader;
+      rreqHeader.SetDst (dst);
+      rreqHeader.SetDstSeqno (rt->GetSeqNo () + 1);
+      BroadcastRequest (rreqHeader, std::min<uint16_t> (rt->GetHop () + m_ttlIncrement, m_netDiameter));
+    }
+  m_timerWheel.Schedule (m_routeRefreshLead / 2, MakeCallback (&RoutingProtocol::CheckActiveFlow, this), dst);
+}
+
+void
+RoutingProtocol::MonitorSnifferRx (Ptr<const Packet> packet, uint16_t channelFreqMhz, WifiTxVector txVector,
+                                   MpduInfo aMpdu, SignalNoiseDbm signalNoise)
+{
+  WifiMacHeader hdr;
+  packet->PeekHeader (hdr);
+  if (hdr.IsCtl ())
+    {
+      // Control frames may not name their transmitter
+      return;
+    }
+  double snr = signalNoise.signal - signalNoise.noise;
+  std::map<Mac48Address, LinkSignal>::iterator i = m_linkSignal.find (hdr.GetAddr2 ());
+  if (i == m_linkSignal.end ())
+    {
+      LinkSignal link;
+      link.fast = snr;
+      link.slow = snr;
+      m_linkSignal.insert (std::make_pair (hdr.GetAddr2 (), link));
+      return;
+    }
+  i->second.fast = 0.5 * i->second.fast + 0.5 * snr;
+  i->second.slow = 0.9 * i->second.slow + 0.1 * snr;
+}
+
+bool
+RoutingProtocol::IsWeakLink (Ipv4Address neighbor)
+{
+  if (!m_enableLinkQuality)
+    {
+      return false;
+    }
+  std::map<Mac48Address, LinkSignal>::const_iterator i = m_linkSignal.find (m_nb.LookupMacAddress (neighbor));
+  return i != m_linkSignal.end () && i->second.slow < m_weakLinkSnr;
+}
+
+bool
+RoutingProtocol::IsSignalFading (Ipv4Address neighbor)
+{
+  std::map<Mac48Address, LinkSignal>::const_iterator i = m_linkSignal.find (m_nb.LookupMacAddress (neighbor));
+  return i != m_linkSignal.end () && i->second.slow - i->second.fast >= m_signalFadeThreshold;
+}
+
+uint32_t
+RoutingProtocol::GetLoad ()
+{
+  UpdateForwardRate ();
+  return static_cast<uint32_t> (m_forwardRate + 0.5) + m_queue.GetSize ();
+}
+
+void
+RoutingProtocol::AppendLoadExtension (Ptr<Packet> packet, uint32_t load) const
+{
+  Ptr<Packet> extension = Create<Packet> ();
+  extension->AddHeader (LoadExtensionHeader (load));
+  packet->AddAtEnd (extension);
+}
 
+bool
+RoutingProtocol::RemoveLoadExtension (Ptr<Packet> packet, uint32_t & load) const
+{
+  LoadExtensionHeader extension;
+  if (packet->GetSize () < extension.GetSerializedSize ())
+    {
+      return false;
+    }
+  packet->PeekHeader (extension);
+  if (!extension.IsValid ())
+    {
+      return false;
     }
+  packet->RemoveHeader (extension);
+  load = extension.GetLoad ();
+  return true;
 }
 
 void
@@ -1445,17 +3756,15 @@ RoutingProtocol::SendReply (RreqHeader const & rreqHeader, RoutingTableEntry con
     }
   RrepHeader rrepHeader ( /*prefixSize=*/ 0, /*hops=*/ 0, /*dst=*/ rreqHeader.GetDst (),
                                           /*dstSeqNo=*/ m_seqNo, /*origin=*/ toOrigin.GetDestination (), /*lifeTime=*/ m_myRouteTimeout);
-  Ptr<Packet> packet = Create<Packet> ();
-  SocketIpTtlTag tag;
-  tag.SetTtl (toOrigin.GetHop ());
-  packet->AddPacketTag (tag);
-  packet->AddHeader (rrepHeader);
-  TypeHeader tHeader (AODVTYPE_RREP);
-  packet->AddHeader (tHeader);
+  Ptr<Packet> packet = CreateControlPacket (rrepHeader, AODVTYPE_RREP, toOrigin.GetHop ());
+  if (m_enableLoadBalancing)
+    {
+      AppendLoadExtension (packet, 0);
+    }
   Ptr<Socket> socket = FindSocketWithInterfaceAddress (toOrigin.GetInterface ());
   NS_ASSERT (socket);
   socket->SendTo (packet, 0, InetSocketAddress (toOrigin.GetNextHop (), AODV_PORT));
-  m_txTrace (packet->Copy ()); // trace
+  m_txTrace (packet); // trace
 }
 
 void
@@ -1481,17 +3790,17 @@ RoutingProtocol::SendReplyByIntermediateNode (RoutingTableEntry & toDst, Routing
   m_routingTable.Update (toDst);
   m_routingTable.Update (toOrigin);
 
-  Ptr<Packet> packet = Create<Packet> ();
-  SocketIpTtlTag tag;
-  tag.SetTtl (toOrigin.GetHop ());
-  packet->AddPacketTag (tag);
-  packet->AddHeader (rrepHeader);
-  TypeHeader tHeader (AODVTYPE_RREP);
-  packet->AddHeader (tHeader);
+  Ptr<Packet> packet = CreateControlPacket (rrepHeader, AODVTYPE_RREP, toOrigin.GetHop ());
+  if (m_enableLoadBalancing)
+    {
+      std::map<Ipv4Address, std::pair<Ipv4Address, uint32_t> >::const_iterator load = m_routeLoad.find (toDst.GetDestination ());
+      bool known = (load != m_routeLoad.end () && load->second.first == toDst.GetNextHop ());
+      AppendLoadExtension (packet, GetLoad () + (known ? load->second.second : 0));
+    }
   Ptr<Socket> socket = FindSocketWithInterfaceAddress (toOrigin.GetInterface ());
   NS_ASSERT (socket);
   socket->SendTo (packet, 0, InetSocketAddress (toOrigin.GetNextHop (), AODV_PORT));
-  m_txTrace (packet->Copy ()); // trace
+  m_txTrace (packet); // trace
 
   // Generating gratuitous RREPs
   if (gratRep)
@@ -1499,18 +3808,12 @@ RoutingProtocol::SendReplyByIntermediateNode (RoutingTableEntry & toDst, Routing
       RrepHeader gratRepHeader (/*prefix size=*/ 0, /*hops=*/ toOrigin.GetHop (), /*dst=*/ toOrigin.GetDestination (),
                                                  /*dst seqno=*/ toOrigin.GetSeqNo (), /*origin=*/ toDst.GetDestination (),
                                                  /*lifetime=*/ toOrigin.GetLifeTime ());
-      Ptr<Packet> packetToDst = Create<Packet> ();
-      SocketIpTtlTag gratTag;
-      gratTag.SetTtl (toDst.GetHop ());
-      packetToDst->AddPacketTag (gratTag);
-      packetToDst->AddHeader (gratRepHeader);
-      TypeHeader type (AODVTYPE_RREP);
-      packetToDst->AddHeader (type);
+      Ptr<Packet> packetToDst = CreateControlPacket (gratRepHeader, AODVTYPE_RREP, toDst.GetHop ());
       Ptr<Socket> socket = FindSocketWithInterfaceAddress (toDst.GetInterface ());
       NS_ASSERT (socket);
-      NS_LOG_LOGIC ("Send gratuitous RREP " << packet->GetUid ());
+      NS_LOG_LOGIC ("Send gratuitous RREP " << packetToDst->GetUid ());
       socket->SendTo (packetToDst, 0, InetSocketAddress (toDst.GetNextHop (), AODV_PORT));
-      m_txTrace (packet->Copy ()); // trace
+      m_txTrace (packetToDst); // trace
     }
 }
 
@@ -1519,19 +3822,13 @@ RoutingProtocol::SendReplyAck (Ipv4Address neighbor)
 {
   NS_LOG_FUNCTION (this << " to " << neighbor);
   RrepAckHeader h;
-  TypeHeader typeHeader (AODVTYPE_RREP_ACK);
-  Ptr<Packet> packet = Create<Packet> ();
-  SocketIpTtlTag tag;
-  tag.SetTtl (1);
-  packet->AddPacketTag (tag);
-  packet->AddHeader (h);
-  packet->AddHeader (typeHeader);
+  Ptr<Packet> packet = CreateControlPacket (h, AODVTYPE_RREP_ACK, 1);
   RoutingTableEntry toNeighbor;
   m_routingTable.LookupRoute (neighbor, toNeighbor);
   Ptr<Socket> socket = FindSocketWithInterfaceAddress (toNeighbor.GetInterface ());
   NS_ASSERT (socket);
   socket->SendTo (packet, 0, InetSocketAddress (neighbor, AODV_PORT));
-  m_txTrace (packet->Copy ()); // trace
+  m_txTrace (packet); // trace
 }
 
 void
@@ -1540,6 +3837,8 @@ RoutingProtocol::RecvReply (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address sen
   NS_LOG_FUNCTION (this << " src " << sender);
   RrepHeader rrepHeader;
   p->RemoveHeader (rrepHeader);
+  uint32_t load = 0;
+  bool hasLoad = m_enableLoadBalancing && RemoveLoadExtension (p, load);
   Ipv4Address dst = rrepHeader.GetDst ();
   NS_LOG_LOGIC ("RREP destination " << dst << " RREP origin " << rrepHeader.GetOrigin ());
 
@@ -1563,9 +3862,9 @@ RoutingProtocol::RecvReply (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address sen
    * -  the expiry time is set to the current time plus the value of the Lifetime in the RREP message,
    * -  and the destination sequence number is the Destination Sequence Number in the RREP message.
    */
-  Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver));
+  Ptr<NetDevice> dev = m_ipv4->GetNetDevice (GetLocalInterface (receiver));
   RoutingTableEntry newEntry (/*device=*/ dev, /*dst=*/ dst, /*validSeqNo=*/ true, /*seqno=*/ rrepHeader.GetDstSeqno (),
-                                          /*iface=*/ m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0),/*hop=*/ hop,
+                                          /*iface=*/ m_ipv4->GetAddress (GetLocalInterface (receiver), 0),/*hop=*/ hop,
                                           /*nextHop=*/ sender, /*lifeTime=*/ rrepHeader.GetLifeTime ());
   RoutingTableEntry toDst;
   if (m_routingTable.LookupRoute (dst, toDst))
@@ -1595,6 +3894,24 @@ RoutingProtocol::RecvReply (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address sen
             {
               m_routingTable.Update (newEntry);
             }
+          // (v)   the sequence numbers are the same, and the new path is lighter and at most LoadHopSlack hops longer.
+          else if (hasLoad && (rrepHeader.GetDstSeqno () == toDst.GetSeqNo ())
+                   && (hop <= toDst.GetHop () + m_loadHopSlack) && IsLighterPath (dst, toDst.GetNextHop (), load))
+            {
+              NS_LOG_DEBUG ("Route to " << dst << " moved to lighter next hop " << sender << " with load " << load);
+              m_routingTable.Update (newEntry);
+            }
+          // (vi)  the sequence numbers are the same, the hop counts too, and the new path leaves over a strong link instead of a weak one.
+          else if ((rrepHeader.GetDstSeqno () == toDst.GetSeqNo ()) && (hop == toDst.GetHop ())
+                   && IsWeakLink (toDst.GetNextHop ()) && !IsWeakLink (sender))
+            {
+              NS_LOG_DEBUG ("Route to " << dst << " moved off weak link to " << toDst.GetNextHop ());
+              m_routingTable.Update (newEntry);
+            }
+          else if (m_enableMultipath)
+            {
+              OfferAlternatePath (dst, sender, receiver, hop, rrepHeader.GetDstSeqno (), rrepHeader.GetLifeTime ());
+            }
         }
     }
   else
@@ -1603,6 +3920,17 @@ RoutingProtocol::RecvReply (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address sen
       NS_LOG_LOGIC ("add new route");
       m_routingTable.AddRoute (newEntry);
     }
+  RoutingTableEntry const * rt = m_routingTable.Find (dst);
+  if (rt != 0 && rt->GetNextHop () == sender && rt->GetHop () == hop)
+    {
+      // The route was set from this RREP
+      m_unconfirmedRoutes.erase (dst);
+      if (hasLoad)
+        {
+          m_routeLoad[dst] = std::make_pair (sender, load);
+        }
+      RecordHopCount (dst, hop);
+    }
   // Acknowledge receipt of the RREP by sending a RREP-ACK message back
   if (rrepHeader.GetAckRequired ())
     {
@@ -1615,10 +3943,23 @@ RoutingProtocol::RecvReply (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address sen
       if (toDst.GetFlag () == IN_SEARCH)
         {
           m_routingTable.Update (newEntry);
-          m_addressReqTimer[dst].Remove ();
-          m_addressReqTimer.erase (dst);
+          std::map<Ipv4Address, TimerWheel::TimerId>::iterator timer = m_addressReqTimer.find (dst);
+          if (timer != m_addressReqTimer.end ())
+            {
+              m_timerWheel.Cancel (timer->second);
+              m_addressReqTimer.erase (timer);
+            }
         }
       m_routingTable.LookupRoute (dst, toDst);
+      if (toDst.GetFlag () == VALID && m_localRepairs.find (dst) != m_localRepairs.end ())
+        {
+          FinishLocalRepair (dst);
+        }
+      std::map<Ipv4Address, ActiveFlow>::iterator flow = m_activeFlows.find (dst);
+      if (flow != m_activeFlows.end ())
+        {
+          flow->second.attempts = 0;
+        }
       SendPacketFromQueue (dst, toDst.GetRoute ());
       return;
     }
@@ -1658,17 +3999,15 @@ RoutingProtocol::RecvReply (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address sen
       return;
     }
 
-  Ptr<Packet> packet = Create<Packet> ();
-  SocketIpTtlTag ttl;
-  ttl.SetTtl (tag.GetTtl () - 1);
-  packet->AddPacketTag (ttl);
-  packet->AddHeader (rrepHeader);
-  TypeHeader tHeader (AODVTYPE_RREP);
-  packet->AddHeader (tHeader);
+  Ptr<Packet> packet = CreateControlPacket (rrepHeader, AODVTYPE_RREP, tag.GetTtl () - 1);
+  if (hasLoad)
+    {
+      AppendLoadExtension (packet, load + GetLoad ());
+    }
   Ptr<Socket> socket = FindSocketWithInterfaceAddress (toOrigin.GetInterface ());
   NS_ASSERT (socket);
   socket->SendTo (packet, 0, InetSocketAddress (toOrigin.GetNextHop (), AODV_PORT));
-  m_txTrace (packet->Copy ()); // trace
+  m_txTrace (packet); // trace
 }
 
 void
@@ -1693,30 +4032,32 @@ RoutingProtocol::ProcessHello (RrepHeader const & rrepHeader, Ipv4Address receiv
    * SHOULD make sure that it has an active route to the neighbor, and
    * create one if necessary.
    */
+  // An adaptive neighbor announces its own, possibly stretched, interval in the lifetime
+  Time helloLifetime = std::max (rrepHeader.GetLifeTime (), Time (m_allowedHelloLoss * m_helloInterval));
   RoutingTableEntry toNeighbor;
   if (!m_routingTable.LookupRoute (rrepHeader.GetDst (), toNeighbor))
     {
-      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver));
+      Ptr<NetDevice> dev = m_ipv4->GetNetDevice (GetLocalInterface (receiver));
       RoutingTableEntry newEntry (/*device=*/ dev, /*dst=*/ rrepHeader.GetDst (), /*validSeqNo=*/ true, /*seqno=*/ rrepHeader.GetDstSeqno (),
-                                              /*iface=*/ m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0),
+                                              /*iface=*/ m_ipv4->GetAddress (GetLocalInterface (receiver), 0),
                                               /*hop=*/ 1, /*nextHop=*/ rrepHeader.GetDst (), /*lifeTime=*/ rrepHeader.GetLifeTime ());
       m_routingTable.AddRoute (newEntry);
     }
   else
     {
-      toNeighbor.SetLifeTime (std::max (Time (m_allowedHelloLoss * m_helloInterval), toNeighbor.GetLifeTime ()));
+      toNeighbor.SetLifeTime (std::max (helloLifetime, toNeighbor.GetLifeTime ()));
       toNeighbor.SetSeqNo (rrepHeader.GetDstSeqno ());
       toNeighbor.SetValidSeqNo (true);
       toNeighbor.SetFlag (VALID);
-      toNeighbor.SetOutputDevice (m_ipv4->GetNetDevice (m_ipv4->GetInterfaceForAddress (receiver)));
-      toNeighbor.SetInterface (m_ipv4->GetAddress (m_ipv4->GetInterfaceForAddress (receiver), 0));
+      toNeighbor.SetOutputDevice (m_ipv4->GetNetDevice (GetLocalInterface (receiver)));
+      toNeighbor.SetInterface (m_ipv4->GetAddress (GetLocalInterface (receiver), 0));
       toNeighbor.SetHop (1);
       toNeighbor.SetNextHop (rrepHeader.GetDst ());
       m_routingTable.Update (toNeighbor);
     }
   if (m_enableHello)
     {
-      m_nb.Update (rrepHeader.GetDst (), Time (m_allowedHelloLoss * m_helloInterval));
+      m_nb.Update (rrepHeader.GetDst (), helloLifetime);
     }
 }
 
@@ -1732,29 +4073,21 @@ RoutingProtocol::RecvError (Ptr<Packet> p, Ipv4Address src )
   std::pair<Ipv4Address, uint32_t> un;
   while (rerrHeader.RemoveUnDestination (un))
     {
-      for (std::map<Ipv4Address, uint32_t>::const_iterator i =
-             dstWithNextHopSrc.begin (); i != dstWithNextHopSrc.end (); ++i)
+      m_alternatePaths.Remove (un.first, src);
+      if (dstWithNextHopSrc.find (un.first) != dstWithNextHopSrc.end ()
+          && !SwitchToAlternatePath (un.first))
         {
-          if (i->first == un.first)
-            {
-              unreachable.insert (un);
-            }
+          unreachable.insert (un);
         }
     }
 
-  std::vector<Ipv4Address> precursors;
+  PrecursorSet precursors;
   for (std::map<Ipv4Address, uint32_t>::const_iterator i = unreachable.begin ();
        i != unreachable.end (); )
     {
       if (!rerrHeader.AddUnDestination (i->first, i->second))
         {
-          TypeHeader typeHeader (AODVTYPE_RERR);
-          Ptr<Packet> packet = Create<Packet> ();
-          SocketIpTtlTag tag;
-          tag.SetTtl (1);
-          packet->AddPacketTag (tag);
-          packet->AddHeader (rerrHeader);
-          packet->AddHeader (typeHeader);
+          Ptr<Packet> packet = CreateControlPacket (rerrHeader, AODVTYPE_RERR, 1);
           SendRerrMessage (packet, precursors);
           rerrHeader.Clear ();
         }
@@ -1762,19 +4095,13 @@ RoutingProtocol::RecvError (Ptr<Packet> p, Ipv4Address src )
         {
           RoutingTableEntry toDst;
           m_routingTable.LookupRoute (i->first, toDst);
-          toDst.GetPrecursors (precursors);
+          AddPrecursors (toDst, precursors);
           ++i;
         }
     }
   if (rerrHeader.GetDestCount () != 0)
     {
-      TypeHeader typeHeader (AODVTYPE_RERR);
-      Ptr<Packet> packet = Create<Packet> ();
-      SocketIpTtlTag tag;
-      tag.SetTtl (1);
-      packet->AddPacketTag (tag);
-      packet->AddHeader (rerrHeader);
-      packet->AddHeader (typeHeader);
+      Ptr<Packet> packet = CreateControlPacket (rerrHeader, AODVTYPE_RERR, 1);
       SendRerrMessage (packet, precursors);
     }
   m_routingTable.InvalidateRoutesWithDst (unreachable);
@@ -1824,6 +4151,10 @@ void
 RoutingProtocol::HelloTimerExpire ()
 {
   NS_LOG_FUNCTION (this);
+  if (m_enableAdaptiveHello)
+    {
+      AdaptHelloInterval ();
+    }
   Time offset = Time (Seconds (0));
   if (m_lastBcastTime > Time (Seconds (0)))
     {
@@ -1835,32 +4166,36 @@ RoutingProtocol::HelloTimerExpire ()
       SendHello ();
     }
   m_htimer.Cancel ();
-  Time diff = m_helloInterval - offset;
+  Time diff = m_currentHelloInterval - offset;
   m_htimer.Schedule (std::max (Time (Seconds (0)), diff));
   m_lastBcastTime = Time (Seconds (0));
 }
 
 void
-RoutingProtocol::RreqRateLimitTimerExpire ()
-{
-  NS_LOG_FUNCTION (this);
-  m_rreqCount = 0;
-  m_rreqRateLimitTimer.Schedule (Seconds (1));
-}
-
-void
-RoutingProtocol::RerrRateLimitTimerExpire ()
+RoutingProtocol::AckTimerExpire (Ipv4Address neighbor, Time blacklistTimeout)
 {
   NS_LOG_FUNCTION (this);
-  m_rerrCount = 0;
-  m_rerrRateLimitTimer.Schedule (Seconds (1));
+  m_routingTable.MarkLinkAsUnidirectional (neighbor, blacklistTimeout);
 }
 
 void
-RoutingProtocol::AckTimerExpire (Ipv4Address neighbor, Time blacklistTimeout)
+RoutingProtocol::AdaptHelloInterval ()
 {
-  NS_LOG_FUNCTION (this);
-  m_routingTable.MarkLinkAsUnidirectional (neighbor, blacklistTimeout);
+  uint32_t churn = m_nb.TakeChurn ();
+  Time interval = m_currentHelloInterval;
+  if (churn == 0)
+    {
+      interval = std::min (2 * interval, m_maxHelloInterval);
+    }
+  else if (churn > 1)
+    {
+      interval = std::max (Time (interval / 2), m_minHelloInterval);
+    }
+  if (interval != m_currentHelloInterval)
+    {
+      NS_LOG_DEBUG ("Hello interval " << interval.GetSeconds () << " s after " << churn << " neighbor changes");
+      m_currentHelloInterval = interval;
+    }
 }
 
 void
@@ -1881,19 +4216,13 @@ RoutingProtocol::SendHello ()
       Ptr<Socket> socket = j->first;
       Ipv4InterfaceAddress iface = j->second;
       RrepHeader helloHeader (/*prefix size=*/ 0, /*hops=*/ 0, /*dst=*/ iface.GetLocal (), /*dst seqno=*/ m_seqNo,
-                                               /*origin=*/ iface.GetLocal (),/*lifetime=*/ Time (m_allowedHelloLoss * m_helloInterval));
-      Ptr<Packet> packet = Create<Packet> ();
-      SocketIpTtlTag tag;
-      tag.SetTtl (1);
-      packet->AddPacketTag (tag);
-      packet->AddHeader (helloHeader);
-      TypeHeader tHeader (AODVTYPE_RREP);
-      packet->AddHeader (tHeader);
+                                               /*origin=*/ iface.GetLocal (),/*lifetime=*/ Time (m_allowedHelloLoss * m_currentHelloInterval));
+      Ptr<Packet> packet = CreateControlPacket (helloHeader, AODVTYPE_RREP, 1);
 
       // Trace just one packet not all brodcasted packets
       if (traceIt)
         {
-          m_txTrace (packet->Copy ()); // trace
+          m_txTrace (packet); // trace
           traceIt = false;
         }
 
@@ -1908,7 +4237,7 @@ RoutingProtocol::SendHello ()
           destination = iface.GetBroadcast ();
         }
       Time jitter = Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10)));
-      Simulator::Schedule (jitter, &RoutingProtocol::SendTo, this, socket, packet, destination);
+      SendJittered (socket, packet, destination, jitter);
     }
 }
 
@@ -1930,8 +4259,11 @@ RoutingProtocol::SendPacketFromQueue (Ipv4Address dst, Ptr<Ipv4Route> route)
         }
       UnicastForwardCallback ucb = queueEntry.GetUnicastForwardCallback ();
       Ipv4Header header = queueEntry.GetIpv4Header ();
-      header.SetSource (route->GetSource ());
-      header.SetTtl (header.GetTtl () + 1); // compensate extra TTL decrement by fake loopback routing
+      if (IsMyOwnAddress (header.GetSource ()))
+        {
+          header.SetSource (route->GetSource ());
+          header.SetTtl (header.GetTtl () + 1); // compensate extra TTL decrement by fake loopback routing
+        }
       ucb (route, p, header);
     }
 }
@@ -1941,7 +4273,7 @@ RoutingProtocol::SendRerrWhenBreaksLinkToNextHop (Ipv4Address nextHop)
 {
   NS_LOG_FUNCTION (this << nextHop);
   RerrHeader rerrHeader;
-  std::vector<Ipv4Address> precursors;
+  PrecursorSet precursors;
   std::map<Ipv4Address, uint32_t> unreachable;
 
   RoutingTableEntry toNextHop;
@@ -1949,22 +4281,44 @@ RoutingProtocol::SendRerrWhenBreaksLinkToNextHop (Ipv4Address nextHop)
     {
       return;
     }
-  toNextHop.GetPrecursors (precursors);
+  AddPrecursors (toNextHop, precursors);
   rerrHeader.AddUnDestination (nextHop, toNextHop.GetSeqNo ());
   m_routingTable.GetListOfDestinationWithNextHop (nextHop, unreachable);
+  m_alternatePaths.RemoveNextHop (nextHop);
+  for (std::map<Ipv4Address, uint32_t>::iterator i = unreachable.begin (); i != unreachable.end (); )
+    {
+      // Routes moved onto an alternate next hop are not broken
+      if (i->first != nextHop && SwitchToAlternatePath (i->first))
+        {
+          unreachable.erase (i++);
+        }
+      else
+        {
+          ++i;
+        }
+    }
+  if (m_enableLocalRepair)
+    {
+      // Routes being repaired are reported only if the repair fails
+      for (std::map<Ipv4Address, uint32_t>::iterator i = unreachable.begin (); i != unreachable.end (); )
+        {
+          if (i->first != nextHop && StartLocalRepair (i->first))
+            {
+              unreachable.erase (i++);
+            }
+          else
+            {
+              ++i;
+            }
+        }
+    }
   for (std::map<Ipv4Address, uint32_t>::const_iterator i = unreachable.begin (); i
        != unreachable.end (); )
     {
       if (!rerrHeader.AddUnDestination (i->first, i->second))
         {
           NS_LOG_LOGIC ("Send RERR message with maximum size.");
-          TypeHeader typeHeader (AODVTYPE_RERR);
-          Ptr<Packet> packet = Create<Packet> ();
-          SocketIpTtlTag tag;
-          tag.SetTtl (1);
-          packet->AddPacketTag (tag);
-          packet->AddHeader (rerrHeader);
-          packet->AddHeader (typeHeader);
+          Ptr<Packet> packet = CreateControlPacket (rerrHeader, AODVTYPE_RERR, 1);
           SendRerrMessage (packet, precursors);
           rerrHeader.Clear ();
         }
@@ -1972,19 +4326,13 @@ RoutingProtocol::SendRerrWhenBreaksLinkToNextHop (Ipv4Address nextHop)
         {
           RoutingTableEntry toDst;
           m_routingTable.LookupRoute (i->first, toDst);
-          toDst.GetPrecursors (precursors);
+          AddPrecursors (toDst, precursors);
           ++i;
         }
     }
   if (rerrHeader.GetDestCount () != 0)
     {
-      TypeHeader typeHeader (AODVTYPE_RERR);
-      Ptr<Packet> packet = Create<Packet> ();
-      SocketIpTtlTag tag;
-      tag.SetTtl (1);
-      packet->AddPacketTag (tag);
-      packet->AddHeader (rerrHeader);
-      packet->AddHeader (typeHeader);
+      Ptr<Packet> packet = CreateControlPacket (rerrHeader, AODVTYPE_RERR, 1);
       SendRerrMessage (packet, precursors);
     }
   unreachable.insert (std::make_pair (nextHop, toNextHop.GetSeqNo ()));
@@ -1993,31 +4341,24 @@ RoutingProtocol::SendRerrWhenBreaksLinkToNextHop (Ipv4Address nextHop)
 
 void
 RoutingProtocol::SendRerrWhenNoRouteToForward (Ipv4Address dst,
-                                               uint32_t dstSeqNo, Ipv4Address origin)
+                                               uint32_t dstSeqNo, Ipv4Address origin, int32_t iif)
 {
   NS_LOG_FUNCTION (this);
   // A node SHOULD NOT originate more than RERR_RATELIMIT RERR messages per second.
-  if (m_rerrCount == m_rerrRateLimit)
+  if (!m_rerrRateLimiter.HasToken ())
     {
-      // Just make sure that the RerrRateLimit timer is running and will expire
-      NS_ASSERT (m_rerrRateLimitTimer.IsRunning ());
       // discard the packet and return
-      NS_LOG_LOGIC ("RerrRateLimit reached at " << Simulator::Now ().GetSeconds () << " with timer delay left "
-                                                << m_rerrRateLimitTimer.GetDelayLeft ().GetSeconds ()
+      NS_LOG_LOGIC ("RerrRateLimit reached at " << Simulator::Now ().GetSeconds () << " with next token in "
+                                                << m_rerrRateLimiter.GetDelay ().GetSeconds ()
                                                 << "; suppressing RERR");
       return;
     }
   RerrHeader rerrHeader;
   rerrHeader.AddUnDestination (dst, dstSeqNo);
   RoutingTableEntry toOrigin;
-  Ptr<Packet> packet = Create<Packet> ();
-  SocketIpTtlTag tag;
-  tag.SetTtl (1);
-  packet->AddPacketTag (tag);
-  packet->AddHeader (rerrHeader);
-  packet->AddHeader (TypeHeader (AODVTYPE_RERR));
+  Ptr<Packet> packet = CreateControlPacket (rerrHeader, AODVTYPE_RERR, 1);
 
-  m_txTrace (packet->Copy ()); // trace
+  m_txTrace (packet); // trace
 
   if (m_routingTable.LookupValidRoute (origin, toOrigin))
     {
@@ -2035,6 +4376,12 @@ RoutingProtocol::SendRerrWhenNoRouteToForward (Ipv4Address dst,
           Ptr<Socket> socket = i->first;
           Ipv4InterfaceAddress iface = i->second;
           NS_ASSERT (socket);
+          // The node the packet came from is only reachable over the interface it arrived on
+          std::map<Ptr<Socket>, uint32_t>::const_iterator k = m_socketInterface.find (socket);
+          if (iif >= 0 && k != m_socketInterface.end () && k->second != (uint32_t) iif)
+            {
+              continue;
+            }
           NS_LOG_LOGIC ("Broadcast RERR message from interface " << iface.GetLocal ());
           // Send to all-hosts broadcast if on /32 addr, subnet-directed otherwise
           Ipv4Address destination;
@@ -2052,73 +4399,90 @@ RoutingProtocol::SendRerrWhenNoRouteToForward (Ipv4Address dst,
 }
 
 void
-RoutingProtocol::SendRerrMessage (Ptr<Packet> packet, std::vector<Ipv4Address> precursors)
+RoutingProtocol::AddPrecursors (RoutingTableEntry const & rt, PrecursorSet & precursors)
+{
+  std::vector<Ipv4Address> list;
+  rt.GetPrecursors (list);
+  for (std::vector<Ipv4Address>::const_iterator i = list.begin (); i != list.end (); ++i)
+    {
+      if (!precursors.addresses.insert (*i).second)
+        {
+          continue;
+        }
+      RoutingTableEntry toPrecursor;
+      if (!m_routingTable.LookupValidRoute (*i, toPrecursor))
+        {
+          continue;
+        }
+      Ipv4InterfaceAddress iface = toPrecursor.GetInterface ();
+      std::vector<std::pair<Ptr<Socket>, Ipv4InterfaceAddress> >::const_iterator j;
+      for (j = precursors.ifaces.begin (); j != precursors.ifaces.end (); ++j)
+        {
+          if (j->second == iface)
+            {
+              break;
+            }
+        }
+      if (j == precursors.ifaces.end ())
+        {
+          Ptr<Socket> socket = FindSocketWithInterfaceAddress (iface);
+          NS_ASSERT (socket);
+          precursors.ifaces.push_back (std::make_pair (socket, iface));
+        }
+    }
+}
+
+void
+RoutingProtocol::SendRerrMessage (Ptr<Packet> packet, PrecursorSet const & precursors)
 {
   NS_LOG_FUNCTION (this);
 
-  m_txTrace (packet->Copy ()); // trace
+  m_txTrace (packet); // trace
 
-  if (precursors.empty ())
+  if (precursors.addresses.empty ())
     {
       NS_LOG_LOGIC ("No precursors");
       return;
     }
   // A node SHOULD NOT originate more than RERR_RATELIMIT RERR messages per second.
-  if (m_rerrCount == m_rerrRateLimit)
+  if (!m_rerrRateLimiter.HasToken ())
     {
-      // Just make sure that the RerrRateLimit timer is running and will expire
-      NS_ASSERT (m_rerrRateLimitTimer.IsRunning ());
       // discard the packet and return
-      NS_LOG_LOGIC ("RerrRateLimit reached at " << Simulator::Now ().GetSeconds () << " with timer delay left "
-                                                << m_rerrRateLimitTimer.GetDelayLeft ().GetSeconds ()
+      NS_LOG_LOGIC ("RerrRateLimit reached at " << Simulator::Now ().GetSeconds () << " with next token in "
+                                                << m_rerrRateLimiter.GetDelay ().GetSeconds ()
                                                 << "; suppressing RERR");
       return;
     }
   // If there is only one precursor, RERR SHOULD be unicast toward that precursor
-  if (precursors.size () == 1)
+  if (precursors.addresses.size () == 1)
     {
-      RoutingTableEntry toPrecursor;
-      if (m_routingTable.LookupValidRoute (precursors.front (), toPrecursor))
+      if (!precursors.ifaces.empty ())
         {
-          Ptr<Socket> socket = FindSocketWithInterfaceAddress (toPrecursor.GetInterface ());
-          NS_ASSERT (socket);
-          NS_LOG_LOGIC ("one precursor => unicast RERR to " << toPrecursor.GetDestination () << " from " << toPrecursor.GetInterface ().GetLocal ());
-          Simulator::Schedule (Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10))), &RoutingProtocol::SendTo, this, socket, packet, precursors.front ());
-          m_rerrCount++;
+          Ipv4Address precursor = *precursors.addresses.begin ();
+          NS_LOG_LOGIC ("one precursor => unicast RERR to " << precursor << " from " << precursors.ifaces.front ().second.GetLocal ());
+          SendJittered (precursors.ifaces.front ().first, packet, precursor, Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10))));
+          m_rerrRateLimiter.Consume ();
         }
       return;
     }
 
   //  Should only transmit RERR on those interfaces which have precursor nodes for the broken route
-  std::vector<Ipv4InterfaceAddress> ifaces;
-  RoutingTableEntry toPrecursor;
-  for (std::vector<Ipv4Address>::const_iterator i = precursors.begin (); i != precursors.end (); ++i)
-    {
-      if (m_routingTable.LookupValidRoute (*i, toPrecursor)
-          && std::find (ifaces.begin (), ifaces.end (), toPrecursor.GetInterface ()) == ifaces.end ())
-        {
-          ifaces.push_back (toPrecursor.GetInterface ());
-        }
-    }
-
-  for (std::vector<Ipv4InterfaceAddress>::const_iterator i = ifaces.begin (); i != ifaces.end (); ++i)
+  for (std::vector<std::pair<Ptr<Socket>, Ipv4InterfaceAddress> >::const_iterator i = precursors.ifaces.begin ();
+       i != precursors.ifaces.end (); ++i)
     {
-      Ptr<Socket> socket = FindSocketWithInterfaceAddress (*i);
-      NS_ASSERT (socket);
-      NS_LOG_LOGIC ("Broadcast RERR message from interface " << i->GetLocal ());
-      // std::cout << "Broadcast RERR message from interface " << i->GetLocal () << std::endl;
+      NS_LOG_LOGIC ("Broadcast RERR message from interface " << i->second.GetLocal ());
       // Send to all-hosts broadcast if on /32 addr, subnet-directed otherwise
       Ptr<Packet> p = packet->Copy ();
       Ipv4Address destination;
-      if (i->GetMask () == Ipv4Mask::GetOnes ())
+      if (i->second.GetMask () == Ipv4Mask::GetOnes ())
         {
           destination = Ipv4Address ("255.255.255.255");
         }
       else
         {
-          destination = i->GetBroadcast ();
+          destination = i->second.GetBroadcast ();
         }
-      Simulator::Schedule (Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10))), &RoutingProtocol::SendTo, this, socket, p, destination);
+      SendJittered (i->first, p, destination, Time (MilliSeconds (m_uniformRandomVariable->GetInteger (0, 10))));
     }
 }
 
@@ -2126,15 +4490,10 @@ Ptr<Socket>
 RoutingProtocol::FindSocketWithInterfaceAddress (Ipv4InterfaceAddress addr ) const
 {
   NS_LOG_FUNCTION (this << addr);
-  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
-         m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
+  std::map<Ipv4Address, uint32_t>::const_iterator i = m_localAddressInterface.find (addr.GetLocal ());
+  if (i != m_localAddressInterface.end () && m_interfaceCache[i->second].iface == addr)
     {
-      Ptr<Socket> socket = j->first;
-      Ipv4InterfaceAddress iface = j->second;
-      if (iface == addr)
-        {
-          return socket;
-        }
+      return m_interfaceCache[i->second].socket;
     }
   Ptr<Socket> socket;
   return socket;
@@ -2144,15 +4503,10 @@ Ptr<Socket>
 RoutingProtocol::FindSubnetBroadcastSocketWithInterfaceAddress (Ipv4InterfaceAddress addr ) const
 {
   NS_LOG_FUNCTION (this << addr);
-  for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
-         m_socketSubnetBroadcastAddresses.begin (); j != m_socketSubnetBroadcastAddresses.end (); ++j)
+  std::map<Ipv4Address, uint32_t>::const_iterator i = m_localAddressInterface.find (addr.GetLocal ());
+  if (i != m_localAddressInterface.end () && m_interfaceCache[i->second].iface == addr)
     {
-      Ptr<Socket> socket = j->first;
-      Ipv4InterfaceAddress iface = j->second;
-      if (iface == addr)
-        {
-          return socket;
-        }
+      return m_interfaceCache[i->second].broadcastSocket;
     }
   Ptr<Socket> socket;
   return socket;
@@ -2165,6 +4519,7 @@ RoutingProtocol::DoInitialize (void)
   uint32_t startTime;
   if (m_enableHello)
     {
+      m_currentHelloInterval = m_helloInterval;
       m_htimer.SetFunction (&RoutingProtocol::HelloTimerExpire, this);
       startTime = m_uniformRandomVariable->GetInteger (0, 100);
       NS_LOG_DEBUG ("Starting at time " << startTime << "ms");
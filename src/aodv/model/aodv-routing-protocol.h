@@ -31,19 +31,651 @@
 #include "aodv-rtable.h"
 #include "aodv-rqueue.h"
 #include "aodv-packet.h"
-#include "aodv-neighbor.h"
-#include "aodv-dpd.h"
 #include "ns3/node.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/output-stream-wrapper.h"
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/ipv4-interface.h"
 #include "ns3/ipv4-l3-protocol.h"
+#include "ns3/arp-cache.h"
+#include "ns3/wifi-mac-header.h"
+#include "ns3/wifi-phy.h"
+#include <deque>
 #include <map>
+#include <queue>
+#include <set>
+#include <unordered_map>
 #include "ns3/traced-callback.h" // trace
 
 namespace ns3 {
 namespace aodv {
+/**
+ * \ingroup aodv
+ *
+ * \brief Hierarchical timing wheel for per-destination protocol timers
+ *
+ * Timers are rounded up to the wheel resolution and filed into the slots of three
+ * wheel levels, so scheduling and cancelling a timer only touch a single slot.
+ * One simulator event is kept pending, for the next tick that has timers to
+ * expire or to move down from an upper level.
+ */
+class TimerWheel
+{
+public:
+  /// Handler of an expired timer, called with the address the timer was scheduled for
+  typedef Callback<void, Ipv4Address> Handler;
+  /// Identifier of a scheduled timer, zero is never handed out
+  typedef uint64_t TimerId;
+
+  /**
+   * constructor
+   * \param resolution the duration of one tick
+   */
+  TimerWheel (Time resolution);
+  /**
+   * Schedule a timer
+   * \param delay the time after which the timer expires, rounded up to a whole tick
+   * \param handler the function to call on expiry
+   * \param address the argument for the handler
+   * \returns the timer identifier
+   */
+  TimerId Schedule (Time delay, Handler handler, Ipv4Address address);
+  /**
+   * Cancel a timer, unknown or expired identifiers are ignored
+   * \param id the timer identifier
+   */
+  void Cancel (TimerId id);
+  /**
+   * Test whether a timer is pending
+   * \param id the timer identifier
+   * \returns true if the timer has neither expired nor been cancelled
+   */
+  bool IsRunning (TimerId id) const;
+  /// Cancel all timers
+  void Clear ();
+
+private:
+  /// A pending timer
+  struct Entry
+  {
+    uint64_t tick;       ///< expiration tick
+    Handler handler;     ///< expiration handler
+    Ipv4Address address; ///< handler argument
+  };
+
+  /// Number of bits of the tick used to index a wheel level
+  static const uint32_t SLOT_BITS = 8;
+  /// Number of slots per wheel level
+  static const uint32_t SLOTS = 1 << SLOT_BITS;
+  /// Number of wheel levels
+  static const uint32_t LEVELS = 3;
+
+  /**
+   * File a timer into the slot matching its distance from the current tick
+   * \param id the timer identifier
+   * \param tick the expiration tick
+   */
+  void Insert (TimerId id, uint64_t tick);
+  /**
+   * Move the timers of an upper level slot down the wheel
+   * \param level the wheel level
+   * \param slot the slot index
+   */
+  void Cascade (uint32_t level, uint32_t slot);
+  /// Process the armed tick
+  void Expire ();
+  /// Schedule the simulator event for the next tick that needs processing
+  void Arm ();
+
+  /// Tick duration
+  Time m_resolution;
+  /// Last processed tick
+  uint64_t m_currentTick;
+  /// Tick for which m_event is scheduled
+  uint64_t m_armedTick;
+  /// Next timer identifier
+  TimerId m_nextId;
+  /// Pending timers
+  std::map<TimerId, Entry> m_timers;
+  /// Identifiers filed per level and slot, cancelled ones are skipped when the slot is processed
+  std::vector<TimerId> m_slots[LEVELS][SLOTS];
+  /// Number of identifiers filed per level
+  uint32_t m_levelCount[LEVELS];
+  /// The single pending simulator event
+  EventId m_event;
+};
+
+/**
+ * \ingroup aodv
+ *
+ * \brief Token bucket holding up to one second worth of tokens
+ *
+ * The bucket is refilled lazily: conformance is computed from the theoretical
+ * arrival time of the next token, so no periodic timer is needed.
+ */
+class TokenBucket
+{
+public:
+  TokenBucket ();
+  /**
+   * Set the rate and fill the bucket
+   * \param rate the number of tokens per second
+   */
+  void SetRate (uint32_t rate);
+  /**
+   * Test whether a token is available
+   * \returns true if Consume would succeed
+   */
+  bool HasToken () const;
+  /**
+   * Take a token if one is available
+   * \returns true if a token was taken
+   */
+  bool Consume ();
+  /**
+   * Get the time until a token is available
+   * \returns zero if a token is available now, one second if the rate is zero
+   */
+  Time GetDelay () const;
+
+private:
+  /// Number of tokens per second
+  uint32_t m_rate;
+  /// Time between two tokens
+  Time m_interval;
+  /// Theoretical time at which the bucket is full again
+  Time m_fullTime;
+};
+
+/**
+ * \ingroup aodv
+ *
+ * \brief Duplicate detection for (address, id) pairs with generation based expiry
+ *
+ * Pairs are kept in an open addressing hash table. Each slot records the generation,
+ * one GENERATIONS-th of the lifetime, in which it was filled. Slots older than
+ * GENERATIONS generations are reused as free ones, so expiry needs no purge pass
+ * and the table only allocates when it has to grow. A pair is remembered for at
+ * least the lifetime and at most one generation longer.
+ */
+class DuplicateCache
+{
+public:
+  /**
+   * constructor
+   * \param lifetime the time during which a pair is remembered
+   */
+  DuplicateCache (Time lifetime);
+  /**
+   * Check that the pair has been seen during the lifetime, and remember it otherwise
+   * \param addr the IP address
+   * \param id the identifier
+   * \returns true if the pair is a duplicate
+   */
+  bool IsDuplicate (Ipv4Address addr, uint32_t id);
+  /**
+   * Check that the packet has been seen during the lifetime, and remember it otherwise
+   * \param p the packet, identified by its UID
+   * \param header the IP header, identified by its source address
+   * \returns true if the packet is a duplicate
+   */
+  bool IsDuplicate (Ptr<const Packet> p, const Ipv4Header & header);
+  /**
+   * Set the lifetime, forgetting all pairs
+   * \param lifetime the time during which a pair is remembered
+   */
+  void SetLifetime (Time lifetime);
+  /**
+   * Get the lifetime
+   * \returns the time during which a pair is remembered
+   */
+  Time GetLifetime () const
+  {
+    return m_lifetime;
+  }
+
+private:
+  /// A hash table slot
+  struct Slot
+  {
+    uint32_t addr;       ///< IP address
+    uint32_t id;         ///< identifier
+    uint32_t generation; ///< generation in which the slot was filled, zero if never used
+  };
+
+  /// Number of generations per lifetime
+  static const uint32_t GENERATIONS = 8;
+  /// Minimal number of slots
+  static const uint32_t MIN_SLOTS = 64;
+
+  /**
+   * Get the current generation
+   * \returns the generation, starting at one
+   */
+  uint32_t GetGeneration () const;
+  /**
+   * Hash a pair
+   * \param addr the IP address
+   * \param id the identifier
+   * \returns the hash value
+   */
+  static uint32_t Hash (uint32_t addr, uint32_t id);
+  /**
+   * Rebuild the table with the live pairs only
+   * \param slots the new number of slots, a power of two
+   */
+  void Rehash (uint32_t slots);
+
+  /// Time during which a pair is remembered
+  Time m_lifetime;
+  /// Hash table
+  std::vector<Slot> m_slots;
+  /// Number of slots ever filled since the last rehash
+  uint32_t m_used;
+};
+
+/**
+ * \ingroup aodv
+ *
+ * \brief Neighbor table with lazy expiry
+ *
+ * Neighbors are kept in a hash table, so refreshing one on the forwarding path
+ * costs a single lookup. An expired neighbor is closed when it is looked up,
+ * or by a single event set for the earliest expiry time kept in a min-heap.
+ * That event is armed whenever the table is not empty; there is no periodic
+ * purge. The heap holds one entry per neighbor, and an entry found outdated
+ * when it comes up is pushed back with the current expiry.
+ */
+class NeighborTable
+{
+public:
+  /// constructor
+  NeighborTable ();
+  /**
+   * Return expire time for neighbor node with address addr, if exists, else return 0.
+   * \param addr the IP address of the neighbor node
+   * \returns the expire time for the neighbor node
+   */
+  Time GetExpireTime (Ipv4Address addr);
+  /**
+   * Check that node with address addr is neighbor
+   * \param addr the IP address to check
+   * \returns true if the node with IP address is a neighbor
+   */
+  bool IsNeighbor (Ipv4Address addr);
+  /**
+   * Update expire time for entry with address addr, if it exists, else add new entry
+   * \param addr the IP address to check
+   * \param expire the expire time for the address
+   */
+  void Update (Ipv4Address addr, Time expire);
+  /// Close the links to all expired neighbors and arm the event for the next expiry
+  void Purge ();
+  /// Remove all entries
+  void Clear ();
+  /**
+   * Get the number of neighbors that joined or left since the last call
+   * \returns the number of links opened or closed
+   */
+  uint32_t TakeChurn ()
+  {
+    uint32_t churn = m_churn;
+    m_churn = 0;
+    return churn;
+  }
+  /**
+   * Add ARP cache to be used to allow layer 2 notifications processing
+   * \param a pointer to the ARP cache to add
+   */
+  void AddArpCache (Ptr<ArpCache> a);
+  /**
+   * Don't use given ARP cache any more (interface is down)
+   * \param a pointer to the ARP cache to delete
+   */
+  void DelArpCache (Ptr<ArpCache> a);
+  /**
+   * Get callback to ProcessTxError
+   * \returns the callback function
+   */
+  Callback<void, WifiMacHeader const &> GetTxErrorCallback () const
+  {
+    return m_txErrorCallback;
+  }
+  /**
+   * Set link failure callback
+   * \param cb the callback function
+   */
+  void SetCallback (Callback<void, Ipv4Address> cb)
+  {
+    m_handleLinkFailure = cb;
+  }
+  /**
+   * Get link failure callback
+   * \returns the link failure callback
+   */
+  Callback<void, Ipv4Address> GetCallback () const
+  {
+    return m_handleLinkFailure;
+  }
+  /**
+   * Find MAC address by IP using list of ARP caches
+   * \param addr the IP address to lookup
+   * \returns the MAC address for the IP address
+   */
+  Mac48Address LookupMacAddress (Ipv4Address addr);
+  /**
+   * Find the IP address of a neighbor by its MAC address
+   * \param hardwareAddress the MAC address of the neighbor
+   * \returns the IP address, or the any address if no neighbor has this MAC address
+   */
+  Ipv4Address LookupIpAddress (Mac48Address hardwareAddress) const;
+
+private:
+  /// Neighbor description
+  struct Neighbor
+  {
+    Mac48Address hardwareAddress; ///< Neighbor MAC address, unknown until found in an ARP cache
+    Time expireTime;              ///< Neighbor expire time
+    uint64_t id;                  ///< identifier of this link, telling it from earlier links to the same address
+  };
+  /// Expiry time of a neighbor, as recorded in the heap
+  struct Expiry
+  {
+    Time time;        ///< expire time
+    Ipv4Address addr; ///< neighbor address
+    uint64_t id;      ///< link identifier
+    /**
+     * Order by time, then address
+     * \param o the other expiry
+     * \returns true if this expiry comes after o
+     */
+    bool operator> (Expiry const & o) const
+    {
+      return time > o.time || (time == o.time && o.addr < addr);
+    }
+  };
+
+  /**
+   * Process layer 2 TX error notification
+   * \param hdr header of the packet
+   */
+  void ProcessTxError (WifiMacHeader const & hdr);
+  /**
+   * Remove a neighbor and report the link failure
+   * \param addr the neighbor address
+   */
+  void Close (Ipv4Address addr);
+  /**
+   * Record the MAC address of a neighbor
+   * \param addr the neighbor address
+   * \param hardwareAddress the MAC address
+   */
+  void IndexMac (Ipv4Address addr, Mac48Address hardwareAddress);
+  /**
+   * Arm the event for an expiry if it is earlier than the armed one
+   * \param t the expire time
+   */
+  void Arm (Time t);
+
+  /// Neighbors by IP address
+  std::unordered_map<Ipv4Address, Neighbor, Ipv4AddressHash> m_nb;
+  /// Neighbors by MAC address
+  std::multimap<Mac48Address, Ipv4Address> m_macIndex;
+  /// Expiry times, earliest first; entries of closed or refreshed neighbors are skipped
+  std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry> > m_heap;
+  /// Event closing the earliest expiring neighbor
+  EventId m_event;
+  /// Expire time m_event was armed for
+  Time m_eventTime;
+  /// Identifier of the next link
+  uint64_t m_nextId;
+  /// Links opened or closed since the last TakeChurn
+  uint32_t m_churn;
+  /// list of ARP cached to be used for layer 2 notifications processing
+  std::vector<Ptr<ArpCache> > m_arp;
+  /// TX error callback
+  Callback<void, WifiMacHeader const &> m_txErrorCallback;
+  /// link failure callback
+  Callback<void, Ipv4Address> m_handleLinkFailure;
+};
+
+/**
+ * \ingroup aodv
+ *
+ * \brief Routing table stored in a flat hash table, with a reverse index from next hop to destinations
+ *
+ * Routes live in a deque that never moves them, indexed by an open addressing
+ * table keyed on the destination, so a route is found without walking a tree
+ * and Find can hand out a pointer to it instead of a copy. Expired routes are
+ * purged when they are looked up, and all at once when the table would grow.
+ *
+ * Every route added or updated through this class is recorded under its next hop,
+ * so the routes affected by a broken link are found without scanning the table.
+ * An index entry is removed when its route moves to another next hop through
+ * Update or is deleted, so the index never outgrows the table.
+ */
+class IndexedRoutingTable
+{
+public:
+  /**
+   * constructor
+   * \param t lifetime of invalidated routes
+   */
+  IndexedRoutingTable (Time t);
+  /**
+   * Add routing table entry if it doesn't yet exist in routing table
+   * \param r routing table entry
+   * \return true in success
+   */
+  bool AddRoute (RoutingTableEntry & r);
+  /**
+   * Delete routing table entry with destination address dst, if it exists.
+   * \param dst destination address
+   * \return true on success
+   */
+  bool DeleteRoute (Ipv4Address dst);
+  /**
+   * Find the routing table entry with destination address dst.
+   *
+   * The entry stays at the same address until the route is deleted, or the
+   * next call that adds or deletes routes. Changes made through it need no
+   * Update, except for the next hop, which must go through Update to keep the
+   * next hop index right.
+   *
+   * \param dst destination address
+   * \return the entry, or 0 if there is none
+   */
+  RoutingTableEntry * Find (Ipv4Address dst);
+  /**
+   * Lookup routing table entry with destination address dst
+   * \param dst destination address
+   * \param rt entry with destination address dst, if exists
+   * \return true on success
+   */
+  bool LookupRoute (Ipv4Address dst, RoutingTableEntry & rt);
+  /**
+   * Lookup route in VALID state
+   * \param dst destination address
+   * \param rt entry with destination address dst, if exists
+   * \return true on success
+   */
+  bool LookupValidRoute (Ipv4Address dst, RoutingTableEntry & rt);
+  /**
+   * Update routing table
+   * \param rt entry with destination address dst, if exists
+   * \return true on success
+   */
+  bool Update (RoutingTableEntry & rt);
+  /**
+   * Lookup routing entries with next hop nextHop
+   *
+   * Only the routes recorded under nextHop are visited.
+   *
+   * \param nextHop the next hop IP address
+   * \param unreachable map of destinations and their sequence numbers
+   */
+  void GetListOfDestinationWithNextHop (Ipv4Address nextHop, std::map<Ipv4Address, uint32_t> & unreachable);
+  /**
+   * Invalidate the listed routes that are still valid, keeping them for the bad link lifetime.
+   * Only the listed destinations are looked up.
+   * \param unreachable routes to invalidate
+   */
+  void InvalidateRoutesWithDst (std::map<Ipv4Address, uint32_t> const & unreachable);
+  /**
+   * Delete all route from interface with address iface
+   * \param iface the interface IP address
+   */
+  void DeleteAllRoutesFromInterface (Ipv4InterfaceAddress iface);
+  /// Delete all entries from routing table
+  void Clear ();
+  /// Delete all outdated entries and invalidate valid entry if Lifetime is expired
+  void Purge ();
+  /**
+   * Mark entry as unidirectional (e.g. add this neighbor to "blacklist" for blacklistTimeout period)
+   * \param neighbor - neighbor address link to which assumed to be unidirectional
+   * \param blacklistTimeout - time for which the neighboring node is put into the blacklist
+   * \return true on success
+   */
+  bool MarkLinkAsUnidirectional (Ipv4Address neighbor, Time blacklistTimeout);
+  /**
+   * Print routing table
+   * \param stream the output stream
+   */
+  void Print (Ptr<OutputStreamWrapper> stream) const;
+  /**
+   * Get the lifetime of invalidated routes
+   * \returns the bad link lifetime
+   */
+  Time GetBadLinkLifetime () const
+  {
+    return m_badLinkLifetime;
+  }
+
+private:
+  /// Slot of the hash table
+  struct Slot
+  {
+    uint32_t dst;   ///< destination address
+    uint32_t entry; ///< position of the route in m_entries plus one, zero if the slot is unused
+  };
+
+  /// Minimal number of slots
+  static const uint32_t MIN_SLOTS = 64;
+
+  /**
+   * Hash a destination address
+   * \param dst the destination address
+   * \returns the hash value
+   */
+  static uint32_t Hash (uint32_t dst);
+  /**
+   * Find the slot of a destination
+   * \param dst the destination address
+   * \returns the slot holding dst, or the unused slot where it would go
+   */
+  uint32_t FindSlot (Ipv4Address dst) const;
+  /**
+   * Purge the route of a slot if its lifetime is over: an invalid route is
+   * deleted and a valid one is invalidated.
+   * \param slot the slot
+   * \returns false if the route was deleted
+   */
+  bool Purge (uint32_t slot);
+  /**
+   * Delete the route of a slot
+   * \param slot the slot; the following slots of its probe sequence may be shifted into it
+   */
+  void Erase (uint32_t slot);
+  /**
+   * Rebuild the hash table
+   * \param slots the new number of slots, a power of two
+   */
+  void Rehash (uint32_t slots);
+  /**
+   * Record the destination of a route under its next hop
+   * \param rt the routing table entry
+   */
+  void Index (RoutingTableEntry const & rt);
+  /**
+   * Remove the destination of a route from the list of its next hop
+   * \param rt the routing table entry
+   */
+  void Unindex (RoutingTableEntry const & rt);
+
+  /// Routes, including unused ones listed in m_free
+  std::deque<RoutingTableEntry> m_entries;
+  /// Positions of unused routes in m_entries
+  std::vector<uint32_t> m_free;
+  /// Hash table from destination to route, filled to at most one half
+  std::vector<Slot> m_slots;
+  /// Number of routes
+  uint32_t m_size;
+  /// Lifetime of invalidated routes
+  Time m_badLinkLifetime;
+  /// Destinations recorded under each next hop, possibly stale
+  std::map<Ipv4Address, std::set<Ipv4Address> > m_nextHopIndex;
+};
+
+/**
+ * \ingroup aodv
+ *
+ * \brief Alternate next hops per destination, for switching paths without a new route discovery
+ *
+ * Holds next hops other than the one in the routing table that were offered by
+ * duplicate RREQs and RREPs. A path is kept only with the same destination
+ * sequence number as the route and a hop count no greater than it, so switching
+ * to it cannot form a loop, and only one path is kept per next hop.
+ */
+class AlternatePathCache
+{
+public:
+  /// An alternate path
+  struct Path
+  {
+    Ipv4Address nextHop;         ///< next hop
+    Ptr<NetDevice> device;       ///< output device
+    Ipv4InterfaceAddress iface;  ///< output interface
+    uint16_t hops;               ///< hop count
+    uint32_t seqNo;              ///< destination sequence number
+    Time expire;                 ///< expire time
+  };
+  /**
+   * Keep a path to a destination, replacing the longest one when there are already maxPaths
+   * \param dst the destination
+   * \param path the path
+   * \param maxPaths the maximum number of paths kept for dst
+   */
+  void Add (Ipv4Address dst, Path const & path, uint32_t maxPaths);
+  /**
+   * Remove the shortest unexpired path to a destination
+   * \param dst the destination
+   * \param seqNo the destination sequence number of the route; paths with another one are dropped
+   * \param path the removed path
+   * \returns true if a path was found
+   */
+  bool Pop (Ipv4Address dst, uint32_t seqNo, Path & path);
+  /**
+   * Forget the path to a destination through a next hop
+   * \param dst the destination
+   * \param nextHop the next hop
+   */
+  void Remove (Ipv4Address dst, Ipv4Address nextHop);
+  /**
+   * Forget all paths through a next hop
+   * \param nextHop the next hop
+   */
+  void RemoveNextHop (Ipv4Address nextHop);
+  /// Remove all entries
+  void Clear ()
+  {
+    m_paths.clear ();
+  }
+
+private:
+  /// Paths by destination
+  std::map<Ipv4Address, std::vector<Path> > m_paths;
+};
+
 /**
  * \ingroup aodv
  *
@@ -59,6 +691,15 @@ public:
   static TypeId GetTypeId (void);
   static const uint32_t AODV_PORT;
 
+  /**
+   * TracedCallback signature for the outcome of a local repair.
+   *
+   * \param [in] dst The destination of the repaired route.
+   * \param [in] success Whether a new route was found.
+   * \param [in] latency Time from the link break to the outcome.
+   */
+  typedef void (* LocalRepairTracedCallback)(Ipv4Address dst, bool success, Time latency);
+
   /// constructor
   RoutingProtocol ();
   virtual ~RoutingProtocol ();
@@ -103,6 +744,32 @@ public:
    * \param len the maximum queue length
    */
   void SetMaxQueueLen (uint32_t len);
+  /**
+   * Get the maximum number of RREQ per second
+   * \returns the RREQ rate limit
+   */
+  uint32_t GetRreqRateLimit () const
+  {
+    return m_rreqRateLimit;
+  }
+  /**
+   * Set the maximum number of RREQ per second
+   * \param rate the RREQ rate limit
+   */
+  void SetRreqRateLimit (uint32_t rate);
+  /**
+   * Get the maximum number of RERR per second
+   * \returns the RERR rate limit
+   */
+  uint32_t GetRerrRateLimit () const
+  {
+    return m_rerrRateLimit;
+  }
+  /**
+   * Set the maximum number of RERR per second
+   * \param rate the RERR rate limit
+   */
+  void SetRerrRateLimit (uint32_t rate);
   /**
    * Get destination only flag
    * \returns the destination only flag
@@ -187,8 +854,8 @@ private:
   uint16_t m_ttlIncrement;            ///< TTL increment for each attempt using the expanding ring search for RREQ dissemination.
   uint16_t m_ttlThreshold;            ///< Maximum TTL value for expanding ring search, TTL = NetDiameter is used beyond this value.
   uint16_t m_timeoutBuffer;           ///< Provide a buffer for the timeout.
-  uint16_t m_rreqRateLimit;           ///< Maximum number of RREQ per second.
-  uint16_t m_rerrRateLimit;           ///< Maximum number of REER per second.
+  uint32_t m_rreqRateLimit;           ///< Maximum number of RREQ per second.
+  uint32_t m_rerrRateLimit;           ///< Maximum number of REER per second.
   Time m_activeRouteTimeout;          ///< Period of time during which the route is considered to be valid.
   uint32_t m_netDiameter;             ///< Net diameter measures the maximum possible number of hops between two nodes in the network
   /**
@@ -218,6 +885,32 @@ private:
   bool m_gratuitousReply;              ///< Indicates whether a gratuitous RREP should be unicast to the node originated route discovery.
   bool m_enableHello;                  ///< Indicates whether a hello messages enable
   bool m_enableBroadcast;              ///< Indicates whether a a broadcast data packets forwarding enable
+  bool m_enableAggregation;            ///< Indicates whether queued control messages are packed into one datagram
+  uint32_t m_maxAggregateSize;         ///< Largest datagram built by aggregating control messages, in bytes
+  double m_gossipProbability;          ///< Probability of rebroadcasting a RREQ
+  uint32_t m_rreqCounterThreshold;     ///< Copies of a RREQ heard before its queued rebroadcast is cancelled, zero to never cancel
+  bool m_enableLocalRepair;            ///< Indicates whether routes broken at this node are repaired locally
+  uint16_t m_maxRepairTtl;             ///< Maximum hop count of a route to be repaired locally
+  uint16_t m_localAddTtl;              ///< Hops added to the known hop count for the TTL of a local repair RREQ
+  bool m_enableMultipath;              ///< Indicates whether alternate next hops are kept to switch to on a link break
+  uint32_t m_maxPaths;                 ///< Maximum number of alternate next hops kept per destination
+  bool m_enableLoadBalancing;          ///< Indicates whether RREQ and RREP carry the load of the relays and lighter paths are preferred
+  uint16_t m_loadHopSlack;             ///< Extra hops a lighter path may have over the shortest one
+  bool m_enableRouteRefresh;           ///< Indicates whether routes of active flows are rediscovered in the background
+  Time m_routeRefreshLead;             ///< How long before an active route or its next hop link expires its background discovery starts
+  double m_signalFadeThreshold;        ///< Drop of the recent SNR from the next hop below its average, in dB, that triggers a background discovery
+  bool m_enableLinkQuality;            ///< Indicates whether links with a low receive SNR are avoided
+  double m_weakLinkSnr;                ///< Average receive SNR, in dB, below which a link is weak
+  Time m_weakLinkRreqDelay;            ///< Delay before processing a RREQ received over a weak link
+  bool m_enablePassiveLearning;        ///< Indicates whether routes are learned from overheard RREPs and data packets
+  Time m_passiveRouteLifetime;         ///< Lifetime of a route learned from overheard packets
+  bool m_enableHopHistory;             ///< Indicates whether the last known hop count of a deleted route seeds the TTL of its rediscovery
+  Time m_hopHistoryLifetime;           ///< How long the hop count of a route is remembered
+  bool m_enableAdaptiveHello;          ///< Indicates whether the hello interval follows the neighbor churn
+  Time m_minHelloInterval;             ///< Shortest hello interval in adaptive mode
+  Time m_maxHelloInterval;             ///< Longest hello interval in adaptive mode
+  bool m_enableChannelStriping;        ///< Indicates whether a RREQ is rebroadcast on the other interfaces before the one it arrived on
+  Time m_channelStripingDelay;         ///< Extra delay of the RREQ rebroadcast on the interface it arrived on
   //\}
 
   /// IP protocol
@@ -226,11 +919,24 @@ private:
   std::map< Ptr<Socket>, Ipv4InterfaceAddress > m_socketAddresses;
   /// Raw subnet directed broadcast socket per each IP interface, map socket -> iface address (IP + mask)
   std::map< Ptr<Socket>, Ipv4InterfaceAddress > m_socketSubnetBroadcastAddresses;
+  /// AODV sockets and address of an IP interface
+  struct InterfaceCacheEntry
+  {
+    Ptr<Socket> socket;          ///< unicast socket, null if AODV does not run on the interface
+    Ptr<Socket> broadcastSocket; ///< subnet directed broadcast socket
+    Ipv4InterfaceAddress iface;  ///< interface address (IP + mask)
+  };
+  /// Sockets and address per IP interface index, rebuilt whenever the socket maps change
+  std::vector<InterfaceCacheEntry> m_interfaceCache;
+  /// IP interface index of each AODV socket
+  std::map<Ptr<Socket>, uint32_t> m_socketInterface;
+  /// IP interface index of each local AODV address
+  std::map<Ipv4Address, uint32_t> m_localAddressInterface;
   /// Loopback device used to defer RREQ until packet will be fully formed
   Ptr<NetDevice> m_lo;
 
   /// Routing table
-  RoutingTable m_routingTable;
+  IndexedRoutingTable m_routingTable;
   /// A "drop-front" queue used by the routing layer to buffer packets to which it does not have a route.
   RequestQueue m_queue;
   /// Broadcast ID
@@ -238,17 +944,131 @@ private:
   /// Request sequence number
   uint32_t m_seqNo;
   /// Handle duplicated RREQ
-  IdCache m_rreqIdCache;
+  DuplicateCache m_rreqIdCache;
   /// Handle duplicated broadcast/multicast packets
-  DuplicatePacketDetection m_dpd;
+  DuplicateCache m_dpd;
   /// Handle neighbors
-  Neighbors m_nb;
-  /// Number of RREQs used for RREQ rate control
-  uint16_t m_rreqCount;
-  /// Number of RERRs used for RERR rate control
-  uint16_t m_rerrCount;
+  NeighborTable m_nb;
+  /// Alternate next hops
+  AlternatePathCache m_alternatePaths;
+  /// RREQ rate control
+  TokenBucket m_rreqRateLimiter;
+  /// RERR rate control
+  TokenBucket m_rerrRateLimiter;
+  /// Destinations whose RREQ waits for the rate limit, in arrival order
+  std::deque<Ipv4Address> m_pendingRreq;
+  /// Event releasing the pending RREQs
+  EventId m_pendingRreqEvent;
+
+  /// Control packet waiting on a jitter queue
+  struct JitterEntry
+  {
+    Ptr<Packet> packet;      ///< packet to send
+    Ipv4Address destination; ///< destination address
+    uint64_t id;             ///< identifier used to cancel the packet
+  };
+  /// Pending control packets of one socket, ordered by release time
+  struct JitterQueue
+  {
+    std::multimap<Time, JitterEntry> pending; ///< packets by release time
+    EventId event;                            ///< release of the earliest packet
+  };
+  /// Jitter queues by AODV socket
+  std::map<Ptr<Socket>, JitterQueue> m_jitterQueues;
+  /// Identifier of the next packet put on a jitter queue
+  uint64_t m_jitterId;
+
+  /// RREQ rebroadcast waiting on the jitter queues
+  struct RreqForward
+  {
+    uint32_t duplicates;                                   ///< copies of the RREQ heard since it was queued
+    std::vector<std::pair<Ptr<Socket>, uint64_t> > sends; ///< queued packets by socket
+    Ipv4Address delayed;                                   ///< interface whose copy waits for the other channels
+  };
+  /// RREQ rebroadcasts that may still be cancelled, by originator and RREQ ID
+  std::map<std::pair<Ipv4Address, uint32_t>, RreqForward> m_rreqForwards;
+  /// Time the last packet of each entry of m_rreqForwards is released, oldest first
+  std::deque<std::pair<Time, std::pair<Ipv4Address, uint32_t> > > m_rreqForwardTimes;
+
+  /// RREQ answered by this node as its destination
+  struct RreqAnswer
+  {
+    uint16_t hops;  ///< hop count of the shortest copy
+    uint32_t load;  ///< load of the path answered last
+  };
+  /// Answered RREQs by originator and RREQ ID
+  std::map<std::pair<Ipv4Address, uint32_t>, RreqAnswer> m_rreqAnswers;
+  /// Expiry of the entries of m_rreqAnswers, in insertion order
+  std::deque<std::pair<Time, std::pair<Ipv4Address, uint32_t> > > m_rreqAnswerTimes;
+  /// Load of the route to each destination, with the next hop it was learned through
+  std::map<Ipv4Address, std::pair<Ipv4Address, uint32_t> > m_routeLoad;
+  /// Moving average of the packets forwarded per second
+  double m_forwardRate;
+  /// Packets forwarded in the current second
+  uint32_t m_forwardCount;
+  /// Start of the current second
+  Time m_forwardWindowStart;
+
+  /// Destination of packets originated by this node
+  struct ActiveFlow
+  {
+    Time lastUse;      ///< time a packet last took the route
+    Time lastAttempt;  ///< time of the last background discovery
+    uint32_t attempts; ///< background discoveries since the last RREP for the destination
+  };
+  /// Active flows by destination
+  std::map<Ipv4Address, ActiveFlow> m_activeFlows;
+  /// Receive SNR averages of a neighbor, in dB
+  struct LinkSignal
+  {
+    double fast;  ///< average over the last few frames
+    double slow;  ///< long-term average
+  };
+  /// Receive SNR averages by transmitter
+  std::map<Mac48Address, LinkSignal> m_linkSignal;
+  /// Pending processing of RREQs received over weak links, in scheduling order
+  std::deque<EventId> m_weakRreqEvents;
+
+  /// Route learned from an overheard packet, used instead of a route discovery
+  struct PassiveRoute
+  {
+    Ipv4Address nextHop;         ///< the neighbor overheard
+    Ptr<NetDevice> device;       ///< output device
+    Ipv4InterfaceAddress iface;  ///< output interface
+    uint16_t hops;               ///< hop count, 0 if unknown
+    Time expire;                 ///< expire time
+  };
+  /// Routes learned from overheard packets, by destination
+  std::map<Ipv4Address, PassiveRoute> m_passiveRoutes;
+  /// What is known of a routing table entry installed from an overheard route, until a RREP confirms it
+  struct UnconfirmedRoute
+  {
+    bool hopsKnown;   ///< whether the hop count of the entry is exact
+    bool validSeqNo;  ///< whether seqNo was known before the entry was installed
+    uint32_t seqNo;   ///< destination sequence number known before, for the RREQs of this node only
+  };
+  /// Unconfirmed routes installed from overheard packets, by destination
+  std::map<Ipv4Address, UnconfirmedRoute> m_unconfirmedRoutes;
+  /// Devices whose packets to other hosts are inspected
+  std::set<Ptr<NetDevice> > m_promiscDevices;
+  /// Initial TTL of the packets originated by the nodes, to tell hop counts from the TTL of overheard packets
+  uint8_t m_defaultTtl;
+
+  /// Last known hop count to each destination, with the time it was learned
+  std::map<Ipv4Address, std::pair<uint16_t, Time> > m_hopHistory;
+  /// Times the entries of m_hopHistory were learned, in order
+  std::deque<std::pair<Time, Ipv4Address> > m_hopHistoryTimes;
 
 private:
+  /// Precursors of broken routes, deduplicated and grouped by outgoing interface
+  struct PrecursorSet
+  {
+    /// Every precursor collected so far
+    std::set<Ipv4Address> addresses;
+    /// Socket and address of each interface with a valid route to a precursor, in discovery order
+    std::vector<std::pair<Ptr<Socket>, Ipv4InterfaceAddress> > ifaces;
+  };
+
   /// Start protocol operation
   void Start ();
   /**
@@ -260,6 +1080,47 @@ private:
    * \param ecb the ErrorCallback function
    */ 
   void DeferredRouteOutput (Ptr<const Packet> p, const Ipv4Header & header, UnicastForwardCallback ucb, ErrorCallback ecb);
+  /**
+   * Learn routes from a packet to another host
+   * \param device the device the packet was received on
+   * \param packet the IP packet
+   * \param protocol the protocol number
+   * \param from the MAC address of the transmitter
+   * \param to the MAC address of the receiver
+   * \param packetType the type of the packet
+   */
+  void PromiscuousRx (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol,
+                      const Address &from, const Address &to, NetDevice::PacketType packetType);
+  /**
+   * Remember an overheard route, unless a shorter one is remembered
+   * \param dst the destination
+   * \param nextHop the neighbor overheard
+   * \param device the device the packet was received on
+   * \param iface the interface the packet was received on
+   * \param hops the hop count through nextHop, 0 if unknown
+   * \param lifetime the lifetime of the route
+   */
+  void LearnPassiveRoute (Ipv4Address dst, Ipv4Address nextHop, Ptr<NetDevice> device,
+                          Ipv4InterfaceAddress iface, uint16_t hops, Time lifetime);
+  /**
+   * Install the overheard route to dst in the routing table, if it is still fresh
+   * \param dst the destination
+   * \returns true if a route was installed
+   */
+  bool UsePassiveRoute (Ipv4Address dst);
+  /**
+   * Remember the hop count of a route that was discovered
+   * \param dst the destination
+   * \param hops the hop count
+   */
+  void RecordHopCount (Ipv4Address dst, uint16_t hops);
+  /**
+   * Find the last known hop count to a destination
+   * \param dst the destination
+   * \param hops the hop count
+   * \returns true if one was remembered
+   */
+  bool LookupHopCount (Ipv4Address dst, uint16_t & hops);
   /**
    * If route exists and is valid, forward packet.
    *
@@ -267,9 +1128,10 @@ private:
    * \param header the IP header
    * \param ucb the UnicastForwardCallback function
    * \param ecb the ErrorCallback function
+   * \param iif the index of the interface the packet was received on
    * \returns true if forwarded
    */ 
-  bool Forwarding (Ptr<const Packet> p, const Ipv4Header & header, UnicastForwardCallback ucb, ErrorCallback ecb);
+  bool Forwarding (Ptr<const Packet> p, const Ipv4Header & header, UnicastForwardCallback ucb, ErrorCallback ecb, int32_t iif);
   /**
    * Repeated attempts by a source node at route discovery for a single destination
    * use the expanding ring search technique.
@@ -309,6 +1171,15 @@ private:
    * \returns the socket associated with the interface
    */
   Ptr<Socket> FindSubnetBroadcastSocketWithInterfaceAddress (Ipv4InterfaceAddress iface) const;
+  /**
+   * Get the IP interface index of a local AODV address
+   *
+   * \param local the local address
+   * \returns the interface index, or -1 if the address is not assigned to this node
+   */
+  int32_t GetLocalInterface (Ipv4Address local) const;
+  /// Rebuild the per-interface socket and address caches from the socket maps
+  void UpdateInterfaceCache ();
   /**
    * Process hello message
    * 
@@ -329,6 +1200,14 @@ private:
   //\{
   /// Receive and process control packet
   void RecvAodv (Ptr<Socket> socket);
+  /**
+   * Split the next message off the front of a received datagram, which may
+   * hold several messages when the sender aggregates them.
+   * \param packet the datagram, shortened by the message
+   * \param tHeader the type header of the message
+   * \returns the message without its type header, or 0 if the type is unknown
+   */
+  Ptr<Packet> RemoveMessage (Ptr<Packet> packet, TypeHeader & tHeader);
   /// Receive RREQ
   void RecvRequest (Ptr<Packet> p, Ipv4Address receiver, Ipv4Address src);
   /// Receive RREP
@@ -345,8 +1224,46 @@ private:
   void SendPacketFromQueue (Ipv4Address dst, Ptr<Ipv4Route> route);
   /// Send hello
   void SendHello ();
-  /// Send RREQ
+  /// Send RREQ, or queue it until the rate limit allows
   void SendRequest (Ipv4Address dst);
+  /// Originate RREQ, the rate limit has already been applied
+  void OriginateRequest (Ipv4Address dst);
+  /**
+   * Complete a RREQ and broadcast it from every interface
+   * \param rreqHeader the RREQ with its destination fields set
+   * \param ttl the IP TTL
+   */
+  void BroadcastRequest (RreqHeader & rreqHeader, uint16_t ttl);
+  /**
+   * Start repairing locally a route whose next hop broke, buffering the packets
+   * to its destination meanwhile
+   * \param dst the destination of the route
+   * \returns false if the route cannot be repaired
+   */
+  bool StartLocalRepair (Ipv4Address dst);
+  /**
+   * End a local repair: resume using the route if one was found, or drop the
+   * buffered packets and report the broken route otherwise
+   * \param dst the destination of the route
+   */
+  void FinishLocalRepair (Ipv4Address dst);
+  /**
+   * Keep a path offered by a duplicate RREQ or RREP as an alternate to the route to dst
+   * \param dst the destination
+   * \param nextHop the neighbor the path goes through
+   * \param receiver the address of the interface the offer was received on
+   * \param hops the hop count of the path
+   * \param seqNo the destination sequence number of the path
+   * \param lifetime the lifetime of the path
+   */
+  void OfferAlternatePath (Ipv4Address dst, Ipv4Address nextHop, Ipv4Address receiver,
+                           uint16_t hops, uint32_t seqNo, Time lifetime);
+  /**
+   * Move the route to dst onto the best alternate path
+   * \param dst the destination
+   * \returns true if the route is valid again
+   */
+  bool SwitchToAlternatePath (Ipv4Address dst);
   /// Send RREP
   void SendReply (RreqHeader const & rreqHeader, RoutingTableEntry const & toOrigin);
   /** Send RREP by intermediate node
@@ -359,15 +1276,23 @@ private:
   void SendReplyAck (Ipv4Address neighbor);
   /// Initiate RERR
   void SendRerrWhenBreaksLinkToNextHop (Ipv4Address nextHop);
+  /**
+   * Collect the precursors of a route, resolving each new one to its outgoing interface once
+   * \param rt the routing table entry
+   * \param precursors the set to extend
+   */
+  void AddPrecursors (RoutingTableEntry const & rt, PrecursorSet & precursors);
   /// Forward RERR
-  void SendRerrMessage (Ptr<Packet> packet,  std::vector<Ipv4Address> precursors);
+  void SendRerrMessage (Ptr<Packet> packet, PrecursorSet const & precursors);
   /**
-   * Send RERR message when no route to forward input packet. Unicast if there is reverse route to originating node, broadcast otherwise.
+   * Send RERR message when no route to forward input packet. Unicast if there is reverse route to originating node,
+   * broadcast on the interface the packet was received on otherwise.
    * \param dst - destination node IP address
    * \param dstSeqNo - destination node sequence number
    * \param origin - originating node IP address
+   * \param iif - index of the interface the packet was received on
    */
-  void SendRerrWhenNoRouteToForward (Ipv4Address dst, uint32_t dstSeqNo, Ipv4Address origin);
+  void SendRerrWhenNoRouteToForward (Ipv4Address dst, uint32_t dstSeqNo, Ipv4Address origin, int32_t iif);
   /// @}
 
   /**
@@ -377,21 +1302,148 @@ private:
    * \param destination - destination node IP address
    */
   void SendTo (Ptr<Socket> socket, Ptr<Packet> packet, Ipv4Address destination);
+  /**
+   * Build a control message ready to be handed to a socket: the message
+   * header preceded by its type header, with the IP TTL tag attached.
+   * Callers send copies of the returned packet on each interface so that
+   * every copy shares the same buffer.
+   * \param header the message header (RREQ, RREP, RERR or RREP-ACK)
+   * \param type the message type
+   * \param ttl the IP TTL to send the message with
+   * \returns the packet
+   */
+  Ptr<Packet> CreateControlPacket (Header const & header, MessageType type, uint8_t ttl) const;
+  /**
+   * Queue a packet on the jitter queue of its socket and send it once the
+   * jitter has elapsed. Each socket keeps a single event for its earliest
+   * pending packet instead of one simulator event per packet.
+   * \param socket the socket to send from
+   * \param packet the packet to send
+   * \param destination the destination address
+   * \param jitter the delay before the packet is released
+   * \returns the identifier to cancel the packet with
+   */
+  uint64_t SendJittered (Ptr<Socket> socket, Ptr<Packet> packet, Ipv4Address destination, Time jitter);
+  /**
+   * Remove a packet from a jitter queue before it is sent
+   * \param socket the socket the packet was queued on
+   * \param id the identifier returned by SendJittered
+   * \returns true if the packet was still queued
+   */
+  bool CancelJittered (Ptr<Socket> socket, uint64_t id);
+  /**
+   * Count a duplicate of a RREQ and cancel its queued rebroadcast once
+   * RreqCounterThreshold copies have been heard.
+   * \param origin the RREQ originator
+   * \param id the RREQ ID
+   */
+  void CountRreqDuplicate (Ipv4Address origin, uint32_t id);
+  /**
+   * Cancel the delayed rebroadcast of a RREQ on the interface a duplicate of it
+   * was received on, since a neighbor on that channel already carried it.
+   * \param origin the RREQ originator
+   * \param id the RREQ ID
+   * \param receiver the address of the interface the duplicate was received on
+   */
+  void CancelStripedRreq (Ipv4Address origin, uint32_t id, Ipv4Address receiver);
+  /// Forget the RREQ rebroadcasts that have all been released
+  void PurgeRreqForwards ();
+  /**
+   * Answer again, along the path it came from, a copy of a RREQ for this node that is lighter than the one answered
+   * \param rreqHeader the RREQ
+   * \param load the load of the path of the copy
+   * \param receiver the address of the interface the copy was received on
+   * \param src the neighbor the copy was received from
+   */
+  void AnswerLighterRequest (RreqHeader const & rreqHeader, uint32_t load, Ipv4Address receiver, Ipv4Address src);
+  /// Forget the answered RREQs whose copies can no longer arrive
+  void PurgeRreqAnswers ();
+  /**
+   * Check whether a path is lighter than the route in use to a destination
+   * \param dst the destination
+   * \param nextHop the next hop of the route in use
+   * \param load the load of the offered path
+   * \returns false if the load of the route in use is unknown
+   */
+  bool IsLighterPath (Ipv4Address dst, Ipv4Address nextHop, uint32_t load) const;
+  /// Fold the packets forwarded in the seconds elapsed into the moving average
+  void UpdateForwardRate ();
+  /**
+   * Record a packet originated by this node taking the route to dst
+   * \param dst the destination
+   */
+  void NoteActiveFlow (Ipv4Address dst);
+  /**
+   * Forget a flow gone idle, or start a background discovery if its route or next hop link is expiring or its next hop fading
+   * \param dst the destination of the flow
+   */
+  void CheckActiveFlow (Ipv4Address dst);
+  /**
+   * Sample the receive SNR of a frame, by transmitter
+   * \param packet the frame
+   * \param channelFreqMhz the channel frequency
+   * \param txVector the TX vector of the frame
+   * \param aMpdu the A-MPDU information
+   * \param signalNoise the signal and noise power
+   */
+  void MonitorSnifferRx (Ptr<const Packet> packet, uint16_t channelFreqMhz, WifiTxVector txVector,
+                         MpduInfo aMpdu, SignalNoiseDbm signalNoise);
+  /**
+   * Check whether the recent SNR from a neighbor has dropped below its average
+   * \param neighbor the IP address of the neighbor
+   * \returns true if the link is fading
+   */
+  bool IsSignalFading (Ipv4Address neighbor);
+  /**
+   * Check whether the average receive SNR from a neighbor is below WeakLinkSnr
+   * \param neighbor the IP address of the neighbor
+   * \returns false if link quality is not used or no frame was heard from the neighbor
+   */
+  bool IsWeakLink (Ipv4Address neighbor);
+  /// \returns the load of this node as a relay: packets forwarded per second plus packets buffered
+  uint32_t GetLoad ();
+  /**
+   * Append a load extension to a RREQ or RREP
+   * \param packet the packet holding the message
+   * \param load the load
+   */
+  void AppendLoadExtension (Ptr<Packet> packet, uint32_t load) const;
+  /**
+   * Remove the load extension following a RREQ or RREP, if any
+   * \param packet the packet holding the rest of the message
+   * \param load the load carried
+   * \returns true if there was a load extension
+   */
+  bool RemoveLoadExtension (Ptr<Packet> packet, uint32_t & load) const;
+  /**
+   * Send the packets of a jitter queue whose release time has come and arm
+   * the event for the next one.
+   * \param socket the socket owning the queue
+   */
+  void JitterQueueExpire (Ptr<Socket> socket);
+  /**
+   * Append to a packet being released the other packets of the same socket
+   * that are due now and go to the same destination with the same TTL, while
+   * they fit in the maximum aggregate size.
+   * \param pending the remaining packets of the socket
+   * \param entry the packet being released
+   */
+  void AggregateQueued (std::multimap<Time, JitterEntry> & pending, JitterEntry & entry);
 
   /// Hello timer
   Timer m_htimer;
+  /// Interval until the next hello, HelloInterval unless adaptive
+  Time m_currentHelloInterval;
   /// Schedule next send of hello message
   void HelloTimerExpire ();
-  /// RREQ rate limit timer
-  Timer m_rreqRateLimitTimer;
-  /// Reset RREQ count and schedule RREQ rate limit timer with delay 1 sec.
-  void RreqRateLimitTimerExpire ();
-  /// RERR rate limit timer
-  Timer m_rerrRateLimitTimer;
-  /// Reset RERR count and schedule RERR rate limit timer with delay 1 sec.
-  void RerrRateLimitTimerExpire ();
-  /// Map IP address + RREQ timer.
-  std::map<Ipv4Address, Timer> m_addressReqTimer;
+  /// Stretch the hello interval while the neighbors are stable, shorten it while they change
+  void AdaptHelloInterval ();
+  /// Send the pending RREQs allowed by the rate limit and wait for the next token if some remain
+  void SendPendingRequests ();
+  /// Timers of the RREQ retries
+  TimerWheel m_timerWheel;
+  /// Map IP address + RREQ retry timer.
+  std::map<Ipv4Address, TimerWheel::TimerId> m_addressReqTimer;
   /**
    * Handle route discovery process
    * \param dst the destination IP address
@@ -409,6 +1461,19 @@ private:
   Ptr<UniformRandomVariable> m_uniformRandomVariable;
   /// Keep track of the last bcast time
   Time m_lastBcastTime;
+
+  /// Local repair in progress
+  struct LocalRepair
+  {
+    Time start;                           ///< time of the link break
+    uint16_t hops;                        ///< hop count of the route before the break
+    std::vector<Ipv4Address> precursors;  ///< precursors of the route
+    TimerWheel::TimerId timer;            ///< end of the route discovery
+  };
+  /// Local repairs by destination
+  std::map<Ipv4Address, LocalRepair> m_localRepairs;
+  /// Traced Callback: outcome of local repairs
+  TracedCallback<Ipv4Address, bool, Time> m_localRepairTrace;
  
   /// Traced Callback: transmitted packets.
   TracedCallback<Ptr<const Packet> > m_txTrace; // trace
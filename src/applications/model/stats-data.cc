@@ -24,6 +24,7 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 #include "ns3/address.h"
 #include "ns3/address-utils.h"
 #include "ns3/log.h"
@@ -37,6 +38,20 @@ namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("StatsData");
 
+// Quantile q of sorted values, interpolated between the closest ranks
+static double
+Quantile (std::vector<double> const & sorted, double q)
+{
+  if (sorted.empty ())
+  {
+    return 0;
+  }
+  double position = q * (sorted.size () - 1);
+  size_t lower = (size_t) position;
+  size_t upper = std::min (lower + 1, sorted.size () - 1);
+  return sorted[lower] + (position - lower) * (sorted[upper] - sorted[lower]);
+}
+
 FlowData::FlowData (NetFlowId fid, std::string fn, bool singleFile) 
     : m_flowId (fid),
       m_fileName (fn),
@@ -76,7 +91,7 @@ FlowData::FlowData (NetFlowId fid, std::string fn, bool singleFile)
 }
 
 void 
-FlowData::PacketReceived (Ptr<const Packet> packet, bool singleFile)
+FlowData::PacketReceived (Ptr<const Packet> packet)
 {
   NS_LOG_FUNCTION (this);
   StatsHeader statsHeader;
@@ -101,34 +116,25 @@ FlowData::PacketReceived (Ptr<const Packet> packet, bool singleFile)
   }
 
   // vector data
-  if (IsFileWriteEnabled ()) m_delayVector.WriteValueToFile (m_fileName, m_scalarData.lastPacketReceived, m_scalarData.lastDelay, singleFile, m_flowId.index, currentSequenceNumber);
+  if (IsFileWriteEnabled ()) m_delayVector.WriteValueToFile (m_fileName, m_scalarData.lastPacketReceived, m_scalarData.lastDelay, m_flowId.index, currentSequenceNumber);
   if (IsMemoryWriteEnabled ()) m_delayVector.AddValueToVector (m_scalarData.lastPacketReceived, m_scalarData.lastDelay); 
 }
 
 
 void
-FlowData::Finalize (bool singleFile, uint32_t allRxPackets)
+FlowData::Finalize (bool singleFile)
 {
   NS_LOG_FUNCTION (this);
-  if (m_fileWriteEnable)
+  // A single file holds only the delays of all flows, StatsFlows writes their summary table separately
+  if (m_fileWriteEnable && !singleFile)
   {
     std::ofstream out (m_fileName.c_str (), std::ios::app);
     out << std::endl;
     out << "Flow Index,Source Node,Source App,Sink Node,Sink App" << std::endl;
     out << m_flowId.index << "," << m_flowId.sourceNodeId << "," << m_flowId.sourceAppId << "," << m_flowId.sinkNodeId << "," << m_flowId.sinkAppId << std::endl;
     
-    uint32_t row;
-    char column;
-    if (singleFile)
-    {
-      row = allRxPackets + 1;
-      column = 'D' + (char) (m_flowId.index);
-    }
-    else
-    {
-      row = m_scalarData.totalRxPackets + 1;
-      column = 'D';
-    }
+    uint32_t row = m_scalarData.totalRxPackets + 1;
+    char column = 'D';
     
     out << "Number of packets for flow," << m_scalarData.totalRxPackets << "," << m_delayVector.GetNValuesWrittenToFile () << std::endl;
 
@@ -178,6 +184,49 @@ FlowData::Finalize (bool singleFile, uint32_t allRxPackets)
   }
 }
 
+void
+FlowData::WriteSummaryHeader (std::ostream &out)
+{
+  out << "Flow Index,Source Node,Source App,Sink Node,Sink App,"
+      << "Tx Packets,Rx Packets,Lost Packets,Rx Bytes,"
+      << "E2E average delay [us],E2E median delay [us],E2E max delay [us],Jitter [us],"
+      << "First packet sent [us],Last packet received [us],Real throughput [bps]" << std::endl;
+}
+
+void
+FlowData::WriteSummary (std::ostream &out) const
+{
+  NS_LOG_FUNCTION (this);
+  std::vector<std::pair<Time,Time>> const & values = m_delayVector.GetValues ();
+  std::vector<double> delays; // [us]
+  delays.reserve (values.size ());
+  double sum = 0;
+  double sumSquares = 0;
+  for (std::vector<std::pair<Time,Time>>::const_iterator i = values.begin (); i != values.end (); ++i)
+  {
+    delays.push_back (i->second.GetDouble () / 1000.0);
+    sum += delays.back ();
+    sumSquares += delays.back () * delays.back ();
+  }
+  std::sort (delays.begin (), delays.end ());
+  double mean = delays.empty () ? 0 : sum / delays.size ();
+  double jitter = 0;
+  if (delays.size () > 1)
+  {
+    jitter = std::sqrt (std::max ((sumSquares - sum * sum / delays.size ()) / (delays.size () - 1), 0.0));
+  }
+
+  uint32_t lost = m_scalarData.totalTxPackets > m_scalarData.totalRxPackets ? m_scalarData.totalTxPackets - m_scalarData.totalRxPackets : 0;
+  Time duration = m_scalarData.lastPacketReceived - m_scalarData.firstPacketSent;
+  double throughput = duration.GetSeconds () ? (double)m_scalarData.totalRxBytes * 8.0 / duration.GetSeconds () : 0;
+
+  out << m_flowId.index << "," << m_flowId.sourceNodeId << "," << m_flowId.sourceAppId << "," << m_flowId.sinkNodeId << "," << m_flowId.sinkAppId << ","
+      << m_scalarData.totalTxPackets << "," << m_scalarData.totalRxPackets << "," << lost << "," << m_scalarData.totalRxBytes << ","
+      << mean << "," << Quantile (delays, 0.5) << "," << (delays.empty () ? 0 : delays.back ()) << "," << jitter << ","
+      << m_scalarData.firstPacketSent.GetDouble () / 1000.0 << "," << m_scalarData.lastPacketReceived.GetDouble () / 1000.0 << ","
+      << throughput << std::endl;
+}
+
 
 void
 StatsFlows::PacketReceived (Ptr<const Packet> packet, uint32_t sinkNodeId, uint32_t sinkAppId)
@@ -191,18 +240,17 @@ StatsFlows::PacketReceived (Ptr<const Packet> packet, uint32_t sinkNodeId, uint3
   uint32_t sourceAppId = statsHeader.GetApplicationId ();
   NetFlowId fid (sourceNodeId, sourceAppId, sinkNodeId, sinkAppId);
   
-  uint16_t i;
-  for (i = 0; i < m_flowIds.size(); i++)
-  {
-    if (fid == m_flowIds[i]) break;
-  }
+  uint32_t i;
+  std::map<NetFlowId, uint32_t>::const_iterator found = m_flowIndices.find (fid);
   
-  if (i == m_flowIds.size())
+  if (found == m_flowIndices.end ())
   {
     NS_LOG_INFO (">>>>>>>>>>>>>>  Novi Flow!!! >>>>>>>>>>>>>>>>>>>>>");
+    i = m_flowData.size ();
     fid.index = i;
-    m_flowIds.push_back (fid);
+    m_flowIndices[fid] = i;
     FlowData fd (fid, m_fileName, m_singleFile);
+    fd.SetMemoryWriteEnable (true); // delays are needed for the summary of all flows
     m_flowData.push_back (fd);
     NS_LOG_INFO ("Novi flow: " << m_flowData[i].GetFlowId ().index 
             << "-SourceNode_" << m_flowData[i].GetFlowId ().sourceNodeId 
@@ -212,14 +260,15 @@ StatsFlows::PacketReceived (Ptr<const Packet> packet, uint32_t sinkNodeId, uint3
   }
   else
   {
-    NS_LOG_INFO ("Nadjen flow: " << m_flowIds[i].index 
-            << "-SourceNode_" << m_flowIds[i].sourceNodeId 
-            << "-SourceApp_" << m_flowIds[i].sourceAppId
-            << "-SinkNode_" << m_flowIds[i].sinkNodeId 
-            << "-SinkApp_" << m_flowIds[i].sinkAppId);
+    i = found->second;
+    NS_LOG_INFO ("Nadjen flow: " << m_flowData[i].GetFlowId ().index 
+            << "-SourceNode_" << m_flowData[i].GetFlowId ().sourceNodeId 
+            << "-SourceApp_" << m_flowData[i].GetFlowId ().sourceAppId
+            << "-SinkNode_" << m_flowData[i].GetFlowId ().sinkNodeId 
+            << "-SinkApp_" << m_flowData[i].GetFlowId ().sinkAppId);
   }
-  NS_LOG_INFO ("i=" << i << ", sizeFlowData=" << m_flowData.size () << ", sizeFlowId=" << m_flowIds.size ());
-  m_flowData[i].PacketReceived (packet, m_singleFile);
+  NS_LOG_INFO ("i=" << i << ", sizeFlowData=" << m_flowData.size () << ", sizeFlowId=" << m_flowIndices.size ());
+  m_flowData[i].PacketReceived (packet);
 }
 
 void
@@ -227,88 +276,162 @@ StatsFlows::Finalize ()
 {
   NS_LOG_FUNCTION (this);
   
-  for (uint16_t i = 0; i < m_flowData.size(); i++)
+  for (uint32_t i = 0; i < m_flowData.size(); i++)
   {
     NS_LOG_INFO ("FINALIZE: call Finalize() for flowId=" << i);
-    m_flowData[i].Finalize (m_singleFile, m_allRxPackets);
+    m_flowData[i].Finalize (m_singleFile);
+  }
+
+  // Summary table with one row per flow
+  if (m_singleFile)
+  {
+    std::ofstream out ((GetBaseName () + "-flows.csv").c_str ());
+    FlowData::WriteSummaryHeader (out);
+    for (uint32_t i = 0; i < m_flowData.size(); i++)
+    {
+      m_flowData[i].WriteSummary (out);
+    }
+    out.close ();
   }
   
   // Stats of all flows
-  int lastRow = m_allRxPackets + 1;
-  int flowDataRaws = 26;
-  int nFlows = m_flowIds.size ();
+  FlowsSummary summary = GetSummary ();
+  WriteSummary (summary);
+}
 
-  std::ofstream out (m_fileName.c_str (), std::ios::app);
-  
-  out << std::endl;
-  out << "AVERAGE RESULTS FOR ALL FLOWS" << std::endl;
+FlowsSummary
+StatsFlows::GetSummary () const
+{
+  NS_LOG_FUNCTION (this);
+  FlowsSummary summary;
+  std::vector<double> delays; // delays of all received packets [ms]
+  delays.reserve (m_allRxPackets);
+  double flowDelaySum = 0;
 
-  // Average e2ed
-  out << "Average E2E Delay [ms]:,=(B" << lastRow+6;
-  for (int i=1; i<nFlows; i++)
+  for (uint32_t i = 0; i < m_flowData.size (); i++)
   {
-    out << "+B" << lastRow+i*flowDataRaws+6;
+    ScalarData const & scalarData = m_flowData[i].GetScalarData ();
+    std::vector<std::pair<Time,Time>> const & values = m_flowData[i].GetDelayVector ().GetValues ();
+    if (values.empty ())
+    {
+      continue;
+    }
+    summary.nFlows++;
+    summary.totalTxPackets += scalarData.totalTxPackets;
+    summary.totalRxPackets += scalarData.totalRxPackets;
+    summary.totalRxBytes += scalarData.totalRxBytes;
+    if (scalarData.totalTxPackets > scalarData.totalRxPackets)
+    {
+      summary.totalLostPackets += scalarData.totalTxPackets - scalarData.totalRxPackets;
+    }
+
+    double flowDelay = 0;
+    for (std::vector<std::pair<Time,Time>>::const_iterator j = values.begin (); j != values.end (); ++j)
+    {
+      delays.push_back (j->second.GetSeconds () * 1000.0);
+      flowDelay += delays.back ();
+    }
+    flowDelaySum += flowDelay / values.size ();
+
+    Time duration = scalarData.lastPacketReceived - scalarData.firstPacketSent;
+    if (duration.GetSeconds ())
+    {
+      summary.aggregateGoodput += (double)scalarData.totalRxBytes * 8.0 / duration.GetSeconds () / 1000.0;
+    }
   }
-  out << ")/1000/" << nFlows << std::endl;
-  
-  
-  // Median e2ed
-  out << "Median E2E Delay [ms]:,=(B" << lastRow+7;
-  for (int i=1; i<nFlows; i++)
+
+  if (delays.empty ())
   {
-    out << "+B" << lastRow+i*flowDataRaws+7;
+    return summary;
   }
-  out << ")/1000/" << nFlows << std::endl;
-  
-  // Max e2ed
-  out << "Max of E2E Delay [ms]:,=(B" << lastRow+8;
-  for (int i=1; i<nFlows; i++)
+
+  double sum = 0;
+  double sumSquares = 0;
+  for (std::vector<double>::const_iterator i = delays.begin (); i != delays.end (); ++i)
   {
-    out << "+B" << lastRow+i*flowDataRaws+8;
+    sum += *i;
+    sumSquares += *i * *i;
   }
-  out << ")/1000/" << nFlows << std::endl;
-  
-  // Jitter e2ed
-  out << "Jitter of E2E Delay [ms]:,=(B" << lastRow+9;
-  for (int i=1; i<nFlows; i++)
+  summary.meanDelay = sum / delays.size ();
+  summary.meanFlowDelay = flowDelaySum / summary.nFlows;
+  if (delays.size () > 1)
   {
-    out << "+B" << lastRow+i*flowDataRaws+9;
+    double variance = (sumSquares - sum * sum / delays.size ()) / (delays.size () - 1);
+    summary.jitter = std::sqrt (std::max (variance, 0.0));
   }
-  out << ")/1000/" << nFlows << std::endl;
-  
-  // Transmitted packets (based on sequence number)
-  out << "Number of all Tx packets:,=C" << lastRow+21;
-  for (int i=1; i<nFlows; i++)
+
+  std::sort (delays.begin (), delays.end ());
+  summary.medianDelay = Quantile (delays, 0.5);
+  summary.p95Delay = Quantile (delays, 0.95);
+  summary.p99Delay = Quantile (delays, 0.99);
+  summary.maxDelay = delays.back ();
+
+  if (summary.totalTxPackets)
   {
-    out << "+C" << lastRow+i*flowDataRaws+21;
+    summary.lostPercent = 100.0 * summary.totalLostPackets / summary.totalTxPackets;
   }
-  out << std::endl;
+  summary.meanFlowGoodput = summary.aggregateGoodput / summary.nFlows;
+  return summary;
+}
 
-  // Received packets
-  out << "Number of all Rx packets:," << m_allRxPackets << std::endl;
-  
-  // Lost
-  out << "Number of all lost packets:,=";
-  std::ostringstream oss;
-  oss << "C" << lastRow+25;
-  for (int i=1; i<nFlows; i++)
+void
+StatsFlows::WriteSummary (FlowsSummary const & summary)
+{
+  NS_LOG_FUNCTION (this);
+  std::vector<std::pair<std::string, double>> fields;
+  fields.push_back (std::make_pair ("flows", summary.nFlows));
+  fields.push_back (std::make_pair ("txPackets", summary.totalTxPackets));
+  fields.push_back (std::make_pair ("rxPackets", summary.totalRxPackets));
+  fields.push_back (std::make_pair ("lostPackets", summary.totalLostPackets));
+  fields.push_back (std::make_pair ("rxBytes", summary.totalRxBytes));
+  fields.push_back (std::make_pair ("lostPercent", summary.lostPercent));
+  fields.push_back (std::make_pair ("meanDelayMs", summary.meanDelay));
+  fields.push_back (std::make_pair ("meanFlowDelayMs", summary.meanFlowDelay));
+  fields.push_back (std::make_pair ("medianDelayMs", summary.medianDelay));
+  fields.push_back (std::make_pair ("p95DelayMs", summary.p95Delay));
+  fields.push_back (std::make_pair ("p99DelayMs", summary.p99Delay));
+  fields.push_back (std::make_pair ("maxDelayMs", summary.maxDelay));
+  fields.push_back (std::make_pair ("jitterMs", summary.jitter));
+  fields.push_back (std::make_pair ("aggregateGoodputKbps", summary.aggregateGoodput));
+  fields.push_back (std::make_pair ("meanFlowGoodputKbps", summary.meanFlowGoodput));
+
+  // <name>.csv -> <name>-summary.json and <name>-summary.csv
+  std::string baseName = GetBaseName ();
+
+  std::ofstream json ((baseName + "-summary.json").c_str ());
+  json.precision (10);
+  json << "{" << std::endl;
+  for (size_t i = 0; i < fields.size (); i++)
   {
-    oss << "+C" << lastRow+i*flowDataRaws+25;
+    json << "  \"" << fields[i].first << "\": " << fields[i].second << (i + 1 < fields.size () ? "," : "") << std::endl;
   }
-  out << oss.str () << std::endl;
-  
-  // Lost %
-  out << "Lost packets [%]:,=100*(" << oss.str () << ")/(" << m_allRxPackets << "+" << oss.str () << ")" << std::endl;
-  
-  // Troughput
-  out << "Real troughput [kbps]:,=(C" << lastRow+26;
-  for (int i=1; i<nFlows; i++)
+  json << "}" << std::endl;
+  json.close ();
+
+  std::ofstream csv ((baseName + "-summary.csv").c_str ());
+  csv.precision (10);
+  for (size_t i = 0; i < fields.size (); i++)
   {
-    out << "+C" << lastRow+i*flowDataRaws+26;
+    csv << (i ? "," : "") << fields[i].first;
   }
-  out << ")/1000/" << nFlows << std::endl;
-  
-  out.close ();
+  csv << std::endl;
+  for (size_t i = 0; i < fields.size (); i++)
+  {
+    csv << (i ? "," : "") << fields[i].second;
+  }
+  csv << std::endl;
+  csv.close ();
+}
+
+std::string
+StatsFlows::GetBaseName () const
+{
+  std::string baseName = m_fileName;
+  if (baseName.size () > 4 && baseName.compare (baseName.size () - 4, 4, ".csv") == 0)
+  {
+    baseName.erase (baseName.size () - 4);
+  }
+  return baseName;
 }
 
 
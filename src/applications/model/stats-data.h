@@ -24,6 +24,8 @@
 #define STATS_DATA_H
 #include <string>
 #include <vector>
+#include <map>
+#include <ostream>
 #include <fstream>
 #include <utility> // std::pair
 #include "ns3/nstime.h"
@@ -44,6 +46,29 @@ struct ScalarData
   Time firstDelay, lastDelay;
 };
 
+// Aggregates of all flows, computed from the delays kept in memory
+struct FlowsSummary
+{
+  FlowsSummary () : nFlows (0), totalTxPackets (0), totalRxPackets (0), totalLostPackets (0), totalRxBytes (0),
+                    lostPercent (0), meanDelay (0), meanFlowDelay (0), medianDelay (0), p95Delay (0), p99Delay (0),
+                    maxDelay (0), jitter (0), aggregateGoodput (0), meanFlowGoodput (0) {};
+  uint32_t nFlows;           // number of flows with at least one received packet
+  uint64_t totalTxPackets;   // packets sent by all flows
+  uint64_t totalRxPackets;   // packets received by all flows
+  uint64_t totalLostPackets; // packets sent but not received
+  uint64_t totalRxBytes;     // bytes received by all flows
+  double lostPercent;        // lost packets as percent of sent packets
+  double meanDelay;          // mean delay of all received packets [ms]
+  double meanFlowDelay;      // mean of the mean delays of the flows [ms]
+  double medianDelay;        // median delay of all received packets [ms]
+  double p95Delay;           // 95th percentile of delay of all received packets [ms]
+  double p99Delay;           // 99th percentile of delay of all received packets [ms]
+  double maxDelay;           // maximum delay of all received packets [ms]
+  double jitter;             // standard deviation of delay of all received packets [ms]
+  double aggregateGoodput;   // sum of the real throughputs of the flows [kbps]
+  double meanFlowGoodput;    // mean real throughput of a flow [kbps]
+};
+
 template<class T>
 class VectorData
 {
@@ -56,10 +81,11 @@ public:
   {
     m_vd.push_back(std::make_pair (time, t));
   };
-  void WriteValueToFile (std::string fileName, Time time, T t, bool singleFile = false, uint16_t flowIndex = 0, uint32_t seqNo = 0);
+  void WriteValueToFile (std::string fileName, Time time, T t, uint32_t flowIndex = 0, uint32_t seqNo = 0);
   void WriteFileHeader (std::string fileName);
   int GetNValuesWrittenToFile () {return m_numValuesWrittenToFile; };
   int GetNValuesWrittenToMemory () {return m_vd.size (); };
+  std::vector<std::pair<Time,T>> const & GetValues () const { return m_vd; };
 private:
   std::string m_name;
   int m_numValuesWrittenToFile;
@@ -67,22 +93,15 @@ private:
 };
 
 template<class T>
-void VectorData<T>::WriteValueToFile (std::string fileName, Time time, T t, bool singleFile, uint16_t flowIndex, uint32_t seqNo)
+void VectorData<T>::WriteValueToFile (std::string fileName, Time time, T t, uint32_t flowIndex, uint32_t seqNo)
 {
   std::ofstream out (fileName.c_str (), std::ios::app);
   
+  // Long format: all flows share the value column and are told apart by the flow index
   out << flowIndex << ",";
   out << time.GetDouble () / 1000.0 << ",";
   out << seqNo << ",";
   
-  if (singleFile)
-  {
-    for (int i=0; i < flowIndex; ++i)
-    {
-      out << ",";
-    }
-  }  
-  
   Time *tp = dynamic_cast<Time*> (&t);
   if (tp != 0)
   { // if T is actually Time print time in mikroseconds
@@ -109,7 +128,7 @@ void VectorData<T>::WriteFileHeader (std::string fileName)
 class NetFlowId
 {
 public:
-  NetFlowId (uint32_t sonid, uint32_t soaid, uint32_t sinid, uint32_t siaid, uint16_t i = 0) 
+  NetFlowId (uint32_t sonid, uint32_t soaid, uint32_t sinid, uint32_t siaid, uint32_t i = 0) 
     : sourceNodeId (sonid),
       sourceAppId (soaid),
       sinkNodeId (sinid),
@@ -117,11 +136,12 @@ public:
       index (i)
   {};
   friend bool operator== (NetFlowId f1, NetFlowId f2);
+  friend bool operator< (NetFlowId f1, NetFlowId f2);
   uint32_t sourceNodeId;
   uint32_t sourceAppId;
   uint32_t sinkNodeId;
   uint32_t sinkAppId;
-  uint16_t index;
+  uint32_t index;
 };
 
 inline bool 
@@ -130,12 +150,22 @@ operator== (NetFlowId f1, NetFlowId f2)
   return (f1.sourceNodeId==f2.sourceNodeId) && (f1.sourceAppId==f2.sourceAppId) && (f1.sinkNodeId==f2.sinkNodeId) && (f1.sinkAppId==f2.sinkAppId);
 }
 
+// Orders flows by their ids, the index is ignored as in operator==
+inline bool 
+operator< (NetFlowId f1, NetFlowId f2) 
+{
+  if (f1.sourceNodeId != f2.sourceNodeId) return f1.sourceNodeId < f2.sourceNodeId;
+  if (f1.sourceAppId != f2.sourceAppId) return f1.sourceAppId < f2.sourceAppId;
+  if (f1.sinkNodeId != f2.sinkNodeId) return f1.sinkNodeId < f2.sinkNodeId;
+  return f1.sinkAppId < f2.sinkAppId;
+}
+
 class FlowData
 {
 public:
   FlowData (NetFlowId fid, std::string fn = "noname", bool singleFile=false);
 
-  void PacketReceived (Ptr<const Packet> packet, bool singleFile);
+  void PacketReceived (Ptr<const Packet> packet);
 
   void SetFileName (std::string fileName) { m_fileName = fileName; };
   void SetFileNamePrefix (std::string fileNamePrefix) { m_fileNamePrefix = fileNamePrefix; };
@@ -143,8 +173,12 @@ public:
   bool IsFileWriteEnabled () { return m_fileWriteEnable; } ;
   void SetMemoryWriteEnable (bool b) { m_memoryWriteEnable = b; };
   bool IsMemoryWriteEnabled () { return m_memoryWriteEnable; };
-  void Finalize (bool singleFile = false, uint32_t allRxPackets = 0); // Final calculations and write to file and to std::cout
+  void Finalize (bool singleFile = false); // Final calculations and write to file and to std::cout
+  static void WriteSummaryHeader (std::ostream &out); // Header of the per-flow summary table
+  void WriteSummary (std::ostream &out) const; // Row of the per-flow summary table, delays are taken from memory
   NetFlowId GetFlowId () { return m_flowId; };
+  ScalarData const & GetScalarData () const { return m_scalarData; };
+  VectorData<Time> const & GetDelayVector () const { return m_delayVector; };
 private:
   NetFlowId m_flowId;
   std::string m_fileName;
@@ -166,9 +200,15 @@ public:
   };
   void PacketReceived (Ptr<const Packet> packet, uint32_t sinkNodeId, uint32_t sinkAppId);
   void Finalize ();
+  FlowsSummary GetSummary () const; // Aggregates of all flows received so far
 
 private:
-  std::vector<NetFlowId> m_flowIds; 
+  // Write the summary as <file name>-summary.json and as a single row of <file name>-summary.csv
+  void WriteSummary (FlowsSummary const & summary);
+  // File name without the .csv extension
+  std::string GetBaseName () const;
+
+  std::map<NetFlowId, uint32_t> m_flowIndices; // index of each flow in m_flowData
   std::vector<FlowData> m_flowData;
   std::string m_fileName;
   uint32_t m_allRxPackets;